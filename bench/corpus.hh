@@ -0,0 +1,248 @@
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+#include <ostream>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lexer/lexemes.hh"
+#include "types/rints.hh"
+
+namespace Bench {
+
+/// \brief Seeded generator of synthetic source text for the lexer.
+/// \details Produces whole statements (declarations, assignments, calls,
+///          `if`/`while` blocks and functions) built from the keywords and
+///          operators in `lexer/lexemes.hh`, mixed with identifiers, integer
+///          and float literals, string literals with escapes and `#`
+///          comments. The same seed and size always produce the same bytes.
+class Corpus {
+  public:
+    explicit Corpus(u64 seed)
+        : rng(seed) {
+#define OP_GEN(x, y) add_op(y);
+        TOKENS(OP_GEN)
+#undef OP_GEN
+    }
+
+    /// UTF-8 text of at least `size` bytes, cut after a full statement.
+    std::string generate(usize size) {
+        std::ostringstream out;
+        write(out, size);
+        return std::move(out).str();
+    }
+
+    /// Stream at least `size` bytes to `os` without holding them in memory.
+    usize write(std::ostream &os, usize size) {
+        std::string out;
+        usize total = 0;
+        depth = 0;
+        while (total + out.size() < size) {
+            statement(out);
+            if (out.size() >= FLUSH) {
+                os.write(out.data(), static_cast<std::streamsize>(out.size()));
+                total += out.size();
+                out.clear();
+            }
+        }
+        os.write(out.data(), static_cast<std::streamsize>(out.size()));
+        return total + out.size();
+    }
+
+  private:
+    std::mt19937_64 rng;
+    std::vector<std::string> ops;
+    usize depth = 0;
+
+    static constexpr usize FLUSH = 1 << 20;
+
+    static constexpr const char *WORDS[] = {
+        "year",  "project", "entry",   "name",  "config", "time",
+        "value", "index",   "result",  "count", "path",   "include",
+        "items", "default", "workspace"};
+
+    void add_op(const wchar_t *lexeme) {
+        std::string op;
+        for (; *lexeme; ++lexeme) {
+            if (*lexeme >= L'a' && *lexeme <= L'z') {
+                return;  // keywords are emitted by the statements themselves
+            }
+            op += static_cast<char>(*lexeme);
+        }
+        if (!op.empty() && op != "(" && op != ")" && op != "{" && op != "}" &&
+            op != "[" && op != "]" && op != ";" && op != ",") {
+            ops.push_back(op);
+        }
+    }
+
+    usize pick(usize n) { return std::uniform_int_distribution<usize>(0, n - 1)(rng); }
+    bool chance(double p) { return std::bernoulli_distribution(p)(rng); }
+
+    void indent(std::string &out) { out.append(depth * 4, ' '); }
+
+    // names are drawn with a skewed distribution: a few are everywhere, most
+    // are rare, like in real scripts
+    usize skewed(usize n) {
+        return std::min<usize>(
+            n - 1, static_cast<usize>(std::exponential_distribution<double>(
+                                          6.0 / static_cast<double>(n))(rng)));
+    }
+
+    void ident(std::string &out) {
+        out += WORDS[skewed(std::size(WORDS))];
+        if (chance(0.5)) {
+            out += '_';
+            out += WORDS[skewed(std::size(WORDS))];
+        }
+        if (chance(0.3)) {
+            out += std::to_string(skewed(100));
+        }
+    }
+
+    void number(std::string &out) {
+        out += std::to_string(pick(chance(0.2) ? 1000000000 : 1000));
+        if (chance(0.2)) {
+            out += '.';
+            out += std::to_string(pick(10000));
+        }
+    }
+
+    void literal(std::string &out) {
+        static constexpr const char *ESCAPES[] = {"\\n", "\\t", "\\\"", "\\\\"};
+        out += '"';
+        for (usize i = 0, n = 4 + pick(60); i < n; ++i) {
+            if (chance(0.03)) {
+                out += ESCAPES[pick(std::size(ESCAPES))];
+            } else if (chance(0.15)) {
+                out += ' ';
+            } else if (chance(0.01)) {
+                out += "\xc3\xa9";  // U+00E9
+            } else {
+                out += static_cast<char>('a' + pick(26));
+            }
+        }
+        out += '"';
+    }
+
+    void expression(std::string &out, usize nest = 0) {
+        switch (nest > 2 ? pick(3) : pick(6)) {
+        case 0:
+            ident(out);
+            break;
+        case 1:
+            number(out);
+            break;
+        case 2:
+            literal(out);
+            break;
+        case 3:
+            expression(out, nest + 1);
+            out += ' ';
+            out += ops[pick(ops.size())];
+            out += ' ';
+            expression(out, nest + 1);
+            break;
+        case 4:
+            ident(out);
+            out += "->";
+            ident(out);
+            out += '(';
+            for (usize i = 0, n = pick(3); i < n; ++i) {
+                if (i) {
+                    out += ", ";
+                }
+                expression(out, nest + 1);
+            }
+            out += ')';
+            break;
+        default:
+            out += '(';
+            expression(out, nest + 1);
+            out += ')';
+            break;
+        }
+    }
+
+    void block(std::string &out) {
+        out += " {\n";
+        ++depth;
+        for (usize i = 0, n = 1 + pick(4); i < n; ++i) {
+            statement(out);
+        }
+        --depth;
+        indent(out);
+        out += "}\n";
+    }
+
+    void statement(std::string &out) {
+        indent(out);
+        usize kind = depth > 3 ? pick(4) : pick(8);
+        switch (kind) {
+        case 0:
+            out += "var ";
+            ident(out);
+            out += " = ";
+            expression(out);
+            out += ";\n";
+            break;
+        case 1:
+            ident(out);
+            out += " = ";
+            expression(out);
+            out += ";\n";
+            break;
+        case 2:
+            out += "# ";
+            for (usize i = 0, n = 2 + pick(10); i < n; ++i) {
+                ident(out);
+                out += ' ';
+            }
+            out += '\n';
+            break;
+        case 3:
+            out += chance(0.5) ? "import " : "return ";
+            ident(out);
+            out += ";\n";
+            break;
+        case 4:
+            out += "if ";
+            expression(out);
+            block(out);
+            if (chance(0.3)) {
+                indent(out);
+                out += "else";
+                block(out);
+            }
+            break;
+        case 5:
+            out += "while ";
+            expression(out);
+            block(out);
+            break;
+        case 6:
+            out += "function ";
+            ident(out);
+            out += '(';
+            for (usize i = 0, n = pick(4); i < n; ++i) {
+                if (i) {
+                    out += ", ";
+                }
+                ident(out);
+            }
+            out += ')';
+            block(out);
+            break;
+        default:
+            expression(out);
+            out += ";\n";
+            break;
+        }
+    }
+};
+
+}  // namespace Bench
+
+#endif  // __CORPUS_H__
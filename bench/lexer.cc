@@ -0,0 +1,171 @@
+// lexer throughput benchmark
+//
+//   bench_lexer [--seed N] [--sizes 1K,64K,1M,...] [--iterations N]
+//               [--mode batched|tokens|parallel] [--dir PATH]
+//
+// every size is generated once with the seeded corpus generator, written to
+// a file and lexed `iterations` times through Lexer::tokenize. sizes accept
+// K, M and G suffixes; the default set stops at 64M, pass 1G explicitly.
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "bench/corpus.hh"
+#include "lexer/lexer.hh"
+#include "thread/pool.hh"
+#include "types/intern.hh"
+
+static std::atomic<u64> allocations{0};
+
+// every replacement goes through this pair, so each block is freed by the
+// allocator that made it whichever form of new and delete is used
+static void *allocate(usize size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+static void release(void *ptr) noexcept { std::free(ptr); }
+
+void *operator new(usize size) { return allocate(size); }
+void *operator new[](usize size) { return allocate(size); }
+void operator delete(void *ptr) noexcept { release(ptr); }
+void operator delete[](void *ptr) noexcept { release(ptr); }
+void operator delete(void *ptr, usize) noexcept { release(ptr); }
+void operator delete[](void *ptr, usize) noexcept { release(ptr); }
+
+namespace {
+struct Options {
+    u64 seed = 0x5eed;
+    std::vector<usize> sizes{1 << 10, 64 << 10, 1 << 20, 16 << 20, 64 << 20};
+    usize iterations = 5;
+    std::string mode = "batched";
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+};
+
+usize parse_size(const std::string &text) {
+    usize pos = 0;
+    usize value = std::stoull(text, &pos);
+    switch (pos < text.size() ? text[pos] | 0x20 : 0) {
+    case 'k':
+        return value << 10;
+    case 'm':
+        return value << 20;
+    case 'g':
+        return value << 30;
+    default:
+        return value;
+    }
+}
+
+Options parse(int argc, char **argv) {
+    Options opts;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if (flag == "--seed") {
+            opts.seed = std::stoull(value);
+        } else if (flag == "--iterations") {
+            opts.iterations = std::max<usize>(1, std::stoull(value));
+        } else if (flag == "--mode") {
+            opts.mode = value;
+        } else if (flag == "--dir") {
+            opts.dir = value;
+        } else if (flag == "--sizes") {
+            opts.sizes.clear();
+            for (usize at = 0; at <= value.size();) {
+                usize comma = std::min(value.find(',', at), value.size());
+                opts.sizes.push_back(parse_size(value.substr(at, comma - at)));
+                at = comma + 1;
+            }
+        } else {
+            std::cerr << "unknown option: " << flag << '\n';
+            std::exit(1);
+        }
+    }
+    return opts;
+}
+
+double peak_rss_mb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_maxrss) / 1024.0;  // KiB on linux
+}
+
+// lex the file once, returning the number of tokens produced
+template <typename Lexer>
+usize lex(Lexer &lexer, const std::string &mode) {
+    usize count = 0;
+    if (mode == "parallel") {
+        count = lexer.tokenize_parallel().size();
+    } else if (mode == "tokens") {
+        for (const auto &token : lexer.tokenize()) {
+            count += token.kind != ::Lexer::TokenKind::END_OF_FILE;
+        }
+        ++count;
+    } else {
+        for (auto batch : lexer.tokenize_batched()) {
+            count += batch.size();
+        }
+    }
+    return count;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options opts = parse(argc, argv);
+    ThreadPool pool;
+
+    std::printf("%10s %12s %10s %14s %12s %10s\n", "size", "tokens", "MB/s",
+                "tokens/s", "allocs/tok", "peak MB");
+
+    for (usize size : opts.sizes) {
+        std::filesystem::path file =
+            opts.dir / ("c-set-bench-" + std::to_string(opts.seed) + "-" +
+                        std::to_string(size) + ".cs");
+        usize bytes = 0;
+        {
+            std::ofstream out(file, std::ios::binary);
+            bytes = Bench::Corpus(opts.seed).write(out, size);
+        }
+
+        double best = 0;
+        usize tokens = 0;
+        u64 allocs = 0;
+
+        for (usize i = 0; i < opts.iterations; ++i) {
+            Interner names;
+            ::Lexer::Lexer<ThreadPool> lexer(file.wstring(), &pool, &names);
+
+            u64 before = allocations.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            tokens = lex(lexer, opts.mode);
+            auto stop = std::chrono::steady_clock::now();
+            allocs = allocations.load(std::memory_order_relaxed) - before;
+
+            double secs = std::chrono::duration<double>(stop - start).count();
+            best = i == 0 ? secs : std::min(best, secs);
+        }
+
+        std::printf("%10zu %12zu %10.1f %14.0f %12.4f %10.1f\n", bytes, tokens,
+                    static_cast<double>(bytes) / best / 1e6,
+                    static_cast<double>(tokens) / best,
+                    static_cast<double>(allocs) / static_cast<double>(tokens),
+                    peak_rss_mb());
+
+        std::filesystem::remove(file);
+    }
+
+    return 0;
+}
@@ -1,12 +1,18 @@
 #ifndef __AST_HH__
 #define __AST_HH__
 
-#include <memory>
-#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
-enum class ASTNodeKind {
+#include "lexer/tokens.hh"
+#include "types/intern.hh"
+#include "types/literal.hh"
+#include "types/rints.hh"
+#include "types/value_type.hh"
+
+enum class ASTNodeKind : u8 {
     Program,
     Block,
     VarDecl,
@@ -25,165 +31,119 @@ enum class ASTNodeKind {
     Call,
     Identifier,
     Number,
-    String
-};
-
-struct ASTNode {
+    String,
+    Deferred
+};
+
+/// Where a variable lives, filled in by `Resolver`.
+enum class Storage : u8 { Unresolved, Global, Local };
+
+/// Index of a node in its `Ast`.
+using NodeId = u32;
+
+/// \brief One node of an `Ast`, three 32-bit operands wide.
+/// \details What the operands hold depends on the kind; lists are indices
+///          into the tree's list storage, see `Ast::list`.
+///
+///          | kind       | a           | b            | c           |
+///          |------------|-------------|--------------|-------------|
+///          | Program    | statements  | globals      |             |
+///          | Block      | statements  |              |             |
+///          | VarDecl    | name        | init?        | slot        |
+///          | FuncDecl   | name        | params       | body        |
+///          | Import     | module      |              |             |
+///          | If         | cond        | then         | else?       |
+///          | While      | cond        | body         |             |
+///          | Return     | value?      |              |             |
+///          | ExprStmt   | expr        |              |             |
+///          | Assign     | name        | value        | slot        |
+///          | Binary     | lhs         | rhs          |             |
+///          | Unary      | operand     |              |             |
+///          | Call       | callee      | args         |             |
+///          | Identifier | name        |              | slot        |
+///          | Number     | value index |              |             |
+///          | String     | text offset | text length  |             |
+///          | Deferred   | first token | token count  |             |
+///
+///          Optional operands hold `Ast::NONE` when absent. `op` is the
+///          operator token of a `Binary` or `Unary`. A `Deferred` node stands
+///          in for a function body the parser skipped, see
+///          `Parser::parse_body`. Slots, `storage` and the global count of
+///          the `Program` are written by `Resolver`, the `type` of an
+///          expression by `TypeInference`.
+struct Node {
     ASTNodeKind kind;
-    virtual ~ASTNode() = default;
-};
-
-using ASTNodePtr = std::shared_ptr<ASTNode>;
-
-struct Program : ASTNode {
-    std::vector<ASTNodePtr> body;
-    Program() { kind = ASTNodeKind::Program; }
-};
-
-struct Block : ASTNode {
-    std::vector<ASTNodePtr> statements;
-    Block() { kind = ASTNodeKind::Block; }
-};
-
-struct VarDecl : ASTNode {
-    std::wstring name;
-    ASTNodePtr init;
-    VarDecl(const std::wstring &n, ASTNodePtr i)
-        : name(n)
-        , init(i) {
-        kind = ASTNodeKind::VarDecl;
-    }
-};
-
-struct FuncDecl : ASTNode {
-    std::wstring name;
-    std::vector<std::wstring> params;
-    ASTNodePtr body;
-    FuncDecl(const std::wstring &n, std::vector<std::wstring> p, ASTNodePtr b)
-        : name(n)
-        , params(std::move(p))
-        , body(b) {
-        kind = ASTNodeKind::FuncDecl;
-    }
-};
-
-struct Import : ASTNode {
-    std::wstring module;
-    Import(const std::wstring &m)
-        : module(m) {
-        kind = ASTNodeKind::Import;
-    }
-};
-
-struct IfStmt : ASTNode {
-    ASTNodePtr cond;
-    ASTNodePtr then_branch;
-    std::optional<ASTNodePtr> else_branch;
-    IfStmt(ASTNodePtr c, ASTNodePtr t, std::optional<ASTNodePtr> e)
-        : cond(c)
-        , then_branch(t)
-        , else_branch(e) {
-        kind = ASTNodeKind::If;
+    Lexer::TokenKind op = Lexer::TokenKind::END_OF_FILE;
+    Storage storage = Storage::Unresolved;
+    ValueType type = ValueType::Unknown;
+    u32 a = 0;
+    u32 b = 0;
+    u32 c = 0;
+};
+
+static_assert(sizeof(Node) == 16);
+
+/// \brief A syntax tree stored in a few flat arrays.
+/// \details Nodes refer to each other by `NodeId`, child lists live back to
+///          back in one array, names are interned and string literals are
+///          copied into one shared buffer. Building a tree costs a handful
+///          of amortized reallocations and freeing it is one `clear`.
+class Ast {
+  public:
+    static constexpr u32 NONE = ~0U;
+
+    NodeId root = NONE;
+
+    NodeId add(Node node) {
+        nodes.push_back(node);
+        return static_cast<NodeId>(nodes.size() - 1);
     }
-};
-
-struct WhileStmt : ASTNode {
-    ASTNodePtr cond;
-    ASTNodePtr body;
-    WhileStmt(ASTNodePtr c, ASTNodePtr b)
-        : cond(c)
-        , body(b) {
-        kind = ASTNodeKind::While;
-    }
-};
-
-struct ReturnStmt : ASTNode {
-    ASTNodePtr value;
-    ReturnStmt(ASTNodePtr v)
-        : value(v) {
-        kind = ASTNodeKind::Return;
-    }
-};
 
-struct BreakStmt : ASTNode {
-    BreakStmt() { kind = ASTNodeKind::Break; }
-};
+    const Node &operator[](NodeId id) const { return nodes[id]; }
+    Node &operator[](NodeId id) { return nodes[id]; }
 
-struct ContinueStmt : ASTNode {
-    ContinueStmt() { kind = ASTNodeKind::Continue; }
-};
+    usize size() const { return nodes.size(); }
 
-struct ExprStmt : ASTNode {
-    ASTNodePtr expr;
-    ExprStmt(ASTNodePtr e)
-        : expr(e) {
-        kind = ASTNodeKind::ExprStmt;
+    /// Store a list of node ids or names, returning its index.
+    u32 list(std::span<const u32> items) {
+        u32 at = static_cast<u32>(lists.size());
+        lists.push_back(static_cast<u32>(items.size()));
+        lists.insert(lists.end(), items.begin(), items.end());
+        return at;
     }
-};
 
-struct Assign : ASTNode {
-    std::wstring name;
-    ASTNodePtr value;
-    Assign(const std::wstring &n, ASTNodePtr v)
-        : name(n)
-        , value(v) {
-        kind = ASTNodeKind::Assign;
+    std::span<const u32> list(u32 at) const {
+        return std::span<const u32>(lists).subspan(at + 1, lists[at]);
     }
-};
 
-struct Binary : ASTNode {
-    std::wstring op;
-    ASTNodePtr left, right;
-    Binary(const std::wstring &o, ASTNodePtr l, ASTNodePtr r)
-        : op(o)
-        , left(l)
-        , right(r) {
-        kind = ASTNodeKind::Binary;
+    u32 number(Literal value) {
+        numbers.push_back(value);
+        return static_cast<u32>(numbers.size() - 1);
     }
-};
 
-struct Unary : ASTNode {
-    std::wstring op;
-    ASTNodePtr operand;
-    Unary(const std::wstring &o, ASTNodePtr opd)
-        : op(o)
-        , operand(opd) {
-        kind = ASTNodeKind::Unary;
-    }
-};
+    Literal number(const Node &node) const { return numbers[node.a]; }
 
-struct Call : ASTNode {
-    std::wstring callee;
-    std::vector<ASTNodePtr> args;
-    Call(const std::wstring &c, std::vector<ASTNodePtr> a)
-        : callee(c)
-        , args(std::move(a)) {
-        kind = ASTNodeKind::Call;
-    }
-};
+    /// Buffer to append a string literal to; record `text.size()` before
+    /// and after as the node's offset and length.
+    string &text() { return strings; }
 
-struct Identifier : ASTNode {
-    std::wstring name;
-    Identifier(const std::wstring &n)
-        : name(n) {
-        kind = ASTNodeKind::Identifier;
+    std::wstring_view text(const Node &node) const {
+        return std::wstring_view(strings).substr(node.a, node.b);
     }
-};
 
-struct Number : ASTNode {
-    std::wstring value;
-    Number(const std::wstring &v)
-        : value(v) {
-        kind = ASTNodeKind::Number;
+    void clear() {
+        root = NONE;
+        nodes.clear();
+        lists.clear();
+        numbers.clear();
+        strings.clear();
     }
-};
 
-struct String : ASTNode {
-    std::wstring value;
-    String(const std::wstring &v)
-        : value(v) {
-        kind = ASTNodeKind::String;
-    }
+  private:
+    std::vector<Node> nodes;
+    std::vector<u32> lists;  // each list is its length, then its items
+    std::vector<Literal> numbers;
+    string strings;
 };
 
 #endif  // __AST_HH__
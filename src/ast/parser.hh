@@ -1,154 +1,249 @@
 #ifndef __PARSER_HH__
 #define __PARSER_HH__
 
-#include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
 #include "ast/ast.hh"
+#include "ast/token_stream.hh"
 #include "lexer/lexer.hh"
+#include "lexer/source.hh"
 #include "lexer/tokens.hh"
 #include "sema/sema.hh"
 
 class ParserContext {
   public:
     Sema sema;
+    Ast ast;
+    // skip function bodies until `Parser::parse_body` asks for them
+    bool lazy_bodies = false;
+
+    explicit ParserContext(const Interner &names)
+        : sema(names) {}
+
     void enter_scope() { sema.enter_scope(); }
     void exit_scope() { sema.exit_scope(); }
 };
 
 class Parser {
-    using TokenIter = std::vector<Lexer::Token>::const_iterator;
-    std::vector<Lexer::Token> tokens;
-    TokenIter current;
+    TokenStream tokens;
+    const Lexer::Source &src;
     ParserContext &ctx;
+    Ast &ast;
+    std::vector<u32> scratch;  // child lists under construction
+    std::vector<Lexer::Token> deferred;  // tokens of skipped bodies
+    bool expanding = false;
 
-    Lexer::Token peek(int offset = 0) const {
-        auto it = current;
-        std::advance(it, offset);
-        return (it != tokens.end())
-                   ? *it
-                   : Lexer::Token(Lexer::TokenKind::END_OF_FILE, L"", 0, 0, 0,
-                                  0, L"");
-    }
-    Lexer::Token advance() {
-        return (current != tokens.end())
-                   ? *current++
-                   : Lexer::Token(Lexer::TokenKind::END_OF_FILE, L"", 0, 0, 0,
-                                  0, L"");
+    // references into the stream, valid until the next peek or advance
+    const Lexer::Token &peek(usize offset = 0) { return tokens.peek(offset); }
+    const Lexer::Token &advance() { return tokens.advance(); }
+    std::wstring text(const Lexer::Token &token) const {
+        return src.value(token);
     }
     bool match(Lexer::TokenKind kind) {
-        if (peek().kind == kind) {
+        if (check(kind)) {
             advance();
             return true;
         }
         return false;
     }
-    bool check(Lexer::TokenKind kind) const { return peek().kind == kind; }
+    bool check(Lexer::TokenKind kind) { return tokens.check(kind); }
+
+    NodeId node(ASTNodeKind kind, u32 a = 0, u32 b = 0, u32 c = 0,
+                Lexer::TokenKind op = Lexer::TokenKind::END_OF_FILE) {
+        return ast.add({.kind = kind, .op = op, .a = a, .b = b, .c = c});
+    }
+
+    // move the items pushed onto `scratch` since `mark` into a tree list
+    u32 take_list(usize mark) {
+        u32 at = ast.list(std::span<const u32>(scratch).subspan(mark));
+        scratch.resize(mark);
+        return at;
+    }
 
   public:
-    Parser(const std::vector<Lexer::Token> &toks, ParserContext &c)
-        : tokens(toks)
-        , current(tokens.begin())
-        , ctx(c) {}
+    /// Parse tokens as they arrive, see `TokenStream`. `src` must be the
+    /// source the tokens are lexed from; it is only read for tokens that
+    /// already arrived.
+    Parser(TokenStream toks, const Lexer::Source &src, ParserContext &c)
+        : tokens(std::move(toks))
+        , src(src)
+        , ctx(c)
+        , ast(c.ast) {}
+
+    Parser(std::span<const Lexer::Token> toks, const Lexer::Source &src,
+           ParserContext &c)
+        : Parser(TokenStream(toks), src, c) {}
+
+    const TokenStream &stream() const { return tokens; }
 
-    ASTNodePtr parse_program() {
-        auto prog = std::make_shared<Program>();
+    /// Parse the whole input into `ctx.ast`, returning its root.
+    NodeId parse_program() {
+        usize mark = scratch.size();
         while (!check(Lexer::TokenKind::END_OF_FILE)) {
-            auto stmt = parse_declaration();
-            if (stmt)
-                prog->body.push_back(stmt);
-            else
+            usize before = tokens.position();
+            NodeId stmt = parse_declaration();
+            if (stmt != Ast::NONE)
+                scratch.push_back(stmt);
+            // skip a token nothing could start with
+            if (stmt == Ast::NONE || tokens.position() == before)
                 advance();
         }
-        return prog;
+        ast.root = node(ASTNodeKind::Program, take_list(mark));
+        return ast.root;
     }
 
-    ASTNodePtr parse_declaration() {
-        if (match(Lexer::TokenKind::IMPORT))
+    NodeId parse_declaration() {
+        switch (peek().kind) {
+        case Lexer::TokenKind::IMPORT:
+            advance();
             return parse_import();
-        if (match(Lexer::TokenKind::VAR))
+        case Lexer::TokenKind::VAR:
+            advance();
             return parse_var_decl();
-        if (match(Lexer::TokenKind::FUNCTION))
+        case Lexer::TokenKind::FUNCTION:
+            advance();
             return parse_func_decl();
-        return parse_statement();
+        default:
+            return parse_statement();
+        }
     }
 
-    ASTNodePtr parse_import() {
+    NodeId parse_import() {
         if (!check(Lexer::TokenKind::IDENTIFIER))
-            return nullptr;
-        auto name = advance().value;
+            return Ast::NONE;
+        NameId name = advance().id;
         ctx.sema.declare_import(name, name);
         match(Lexer::TokenKind::SEMICOLON);
-        return std::make_shared<Import>(name);
+        return node(ASTNodeKind::Import, name);
     }
 
-    ASTNodePtr parse_var_decl() {
+    NodeId parse_var_decl() {
         if (!check(Lexer::TokenKind::IDENTIFIER))
-            return nullptr;
-        auto name = advance().value;
-        ASTNodePtr init = nullptr;
+            return Ast::NONE;
+        NameId name = advance().id;
+        NodeId init = Ast::NONE;
         if (match(Lexer::TokenKind::ASSIGN)) {
             init = parse_expression();
         }
         ctx.sema.declare_variable(name, L"auto", std::nullopt);
         match(Lexer::TokenKind::SEMICOLON);
-        return std::make_shared<VarDecl>(name, init);
+        return node(ASTNodeKind::VarDecl, name, init);
     }
 
-    ASTNodePtr parse_func_decl() {
+    NodeId parse_func_decl() {
         if (!check(Lexer::TokenKind::IDENTIFIER))
-            return nullptr;
-        auto name = advance().value;
-        std::vector<std::wstring> params;
+            return Ast::NONE;
+        NameId name = advance().id;
         if (!match(Lexer::TokenKind::OPEN_PAREN))
-            return nullptr;
+            return Ast::NONE;
+        usize mark = scratch.size();
         while (!check(Lexer::TokenKind::CLOSE_PAREN) &&
                !check(Lexer::TokenKind::END_OF_FILE)) {
             if (check(Lexer::TokenKind::IDENTIFIER)) {
-                params.push_back(advance().value);
+                scratch.push_back(advance().id);
                 if (!check(Lexer::TokenKind::CLOSE_PAREN))
                     match(Lexer::TokenKind::COMMA);
             } else {
                 break;
             }
         }
-        if (!match(Lexer::TokenKind::CLOSE_PAREN))
-            return nullptr;
+        if (!match(Lexer::TokenKind::CLOSE_PAREN)) {
+            scratch.resize(mark);
+            return Ast::NONE;
+        }
+        u32 params = take_list(mark);
+        std::vector<NameId> names(ast.list(params).begin(),
+                                  ast.list(params).end());
+        bool lazy = ctx.lazy_bodies && !expanding;
+        NodeId body = lazy && match(Lexer::TokenKind::OPEN_BRACE)
+                          ? skip_body()
+                          : parse_function_body(names);
+        ctx.sema.declare_function(name, L"auto", names, std::nullopt);
+        return node(ASTNodeKind::FuncDecl, name, params, body);
+    }
+
+    /// Parse the body of `func` if it was skipped in lazy mode, returning
+    /// the body. Functions nested in it are parsed right away.
+    NodeId parse_body(NodeId func) {
+        NodeId body = ast[func].c;
+        if (body == Ast::NONE || ast[body].kind != ASTNodeKind::Deferred)
+            return body;
+
+        const Node &skipped = ast[body];
+        auto range = std::span<const Lexer::Token>(deferred).subspan(
+            skipped.a, skipped.b);
+        TokenStream outer = std::exchange(tokens, TokenStream(range));
+        expanding = true;
+
+        auto params = ast.list(ast[func].b);
+        std::vector<NameId> names(params.begin(), params.end());
+        body = parse_function_body(names, true);
+
+        expanding = false;
+        tokens = std::move(outer);
+        ast[func].c = body;
+        return body;
+    }
+
+    NodeId parse_function_body(const std::vector<NameId> &params,
+                               bool already_matched = false) {
         ctx.enter_scope();
-        for (const auto &param : params)
+        for (NameId param : params)
             ctx.sema.declare_variable(param, L"auto", std::nullopt);
-        ASTNodePtr body = parse_block();
+        NodeId body = parse_block(already_matched);
         ctx.exit_scope();
-        ctx.sema.declare_function(name, L"auto", params, std::nullopt);
-        return std::make_shared<FuncDecl>(name, params, body);
+        return body;
     }
 
-    ASTNodePtr parse_statement() {
-        if (match(Lexer::TokenKind::IF))
+    // keep the tokens up to the matching brace for `parse_body`
+    NodeId skip_body() {
+        u32 first = static_cast<u32>(deferred.size());
+        usize depth = 1;
+        while (depth != 0 && !check(Lexer::TokenKind::END_OF_FILE)) {
+            deferred.push_back(advance());
+            if (deferred.back().kind == Lexer::TokenKind::OPEN_BRACE)
+                ++depth;
+            else if (deferred.back().kind == Lexer::TokenKind::CLOSE_BRACE)
+                --depth;
+        }
+        return node(ASTNodeKind::Deferred, first,
+                    static_cast<u32>(deferred.size()) - first);
+    }
+
+    NodeId parse_statement() {
+        switch (peek().kind) {
+        case Lexer::TokenKind::IF:
+            advance();
             return parse_if();
-        if (match(Lexer::TokenKind::WHILE))
+        case Lexer::TokenKind::WHILE:
+            advance();
             return parse_while();
-        if (match(Lexer::TokenKind::RETURN))
+        case Lexer::TokenKind::RETURN:
+            advance();
             return parse_return();
-        if (match(Lexer::TokenKind::BREAK)) {
+        case Lexer::TokenKind::BREAK:
+            advance();
             match(Lexer::TokenKind::SEMICOLON);
-            return std::make_shared<BreakStmt>();
-        }
-        if (match(Lexer::TokenKind::CONTINUE)) {
+            return node(ASTNodeKind::Break);
+        case Lexer::TokenKind::CONTINUE:
+            advance();
             match(Lexer::TokenKind::SEMICOLON);
-            return std::make_shared<ContinueStmt>();
-        }
-        if (match(Lexer::TokenKind::OPEN_BRACE))
+            return node(ASTNodeKind::Continue);
+        case Lexer::TokenKind::OPEN_BRACE:
+            advance();
             return parse_block(true);
-        return parse_expression_statement();
+        default:
+            return parse_expression_statement();
+        }
     }
 
-    ASTNodePtr parse_if() {
-        auto cond = parse_expression();
-        ASTNodePtr then_branch = parse_block();
-        std::optional<ASTNodePtr> else_branch;
+    NodeId parse_if() {
+        NodeId cond = parse_expression();
+        NodeId then_branch = parse_block();
+        NodeId else_branch = Ast::NONE;
         if (match(Lexer::TokenKind::ELSE)) {
             if (check(Lexer::TokenKind::IF)) {
                 advance();
@@ -157,114 +252,128 @@ class Parser {
                 else_branch = parse_block();
             }
         }
-        return std::make_shared<IfStmt>(cond, then_branch, else_branch);
+        return node(ASTNodeKind::If, cond, then_branch, else_branch);
     }
 
-    ASTNodePtr parse_while() {
-        auto cond = parse_expression();
-        ASTNodePtr body = parse_block();
-        return std::make_shared<WhileStmt>(cond, body);
+    NodeId parse_while() {
+        NodeId cond = parse_expression();
+        NodeId body = parse_block();
+        return node(ASTNodeKind::While, cond, body);
     }
 
-    ASTNodePtr parse_return() {
-        ASTNodePtr value = nullptr;
+    NodeId parse_return() {
+        NodeId value = Ast::NONE;
         if (!check(Lexer::TokenKind::SEMICOLON))
             value = parse_expression();
         match(Lexer::TokenKind::SEMICOLON);
-        return std::make_shared<ReturnStmt>(value);
+        return node(ASTNodeKind::Return, value);
     }
 
-    ASTNodePtr parse_block(bool already_matched = false) {
+    NodeId parse_block(bool already_matched = false) {
         if (!already_matched && !match(Lexer::TokenKind::OPEN_BRACE))
-            return nullptr;
-        auto block = std::make_shared<Block>();
+            return Ast::NONE;
+        usize mark = scratch.size();
         ctx.enter_scope();
         while (!check(Lexer::TokenKind::CLOSE_BRACE) &&
                !check(Lexer::TokenKind::END_OF_FILE)) {
-            auto stmt = parse_declaration();
-            if (stmt)
-                block->statements.push_back(stmt);
-            else
+            usize before = tokens.position();
+            NodeId stmt = parse_declaration();
+            if (stmt != Ast::NONE)
+                scratch.push_back(stmt);
+            // skip a token nothing could start with
+            if (stmt == Ast::NONE || tokens.position() == before)
                 advance();
         }
         match(Lexer::TokenKind::CLOSE_BRACE);
         ctx.exit_scope();
-        return block;
+        return node(ASTNodeKind::Block, take_list(mark));
     }
 
-    ASTNodePtr parse_expression_statement() {
-        auto expr = parse_expression();
+    NodeId parse_expression_statement() {
+        NodeId expr = parse_expression();
         match(Lexer::TokenKind::SEMICOLON);
-        return std::make_shared<ExprStmt>(expr);
+        return node(ASTNodeKind::ExprStmt, expr);
     }
 
-    ASTNodePtr parse_expression() { return parse_assignment(); }
+    NodeId parse_expression() { return parse_assignment(); }
 
-    ASTNodePtr parse_assignment() {
-        auto left = parse_binary();
+    NodeId parse_assignment() {
+        NodeId left = parse_binary();
         if (match(Lexer::TokenKind::ASSIGN)) {
-            if (auto id = std::dynamic_pointer_cast<Identifier>(left)) {
-                auto value = parse_assignment();
-                ctx.sema.declare_variable(id->name, L"auto", std::nullopt);
-                return std::make_shared<Assign>(id->name, value);
+            if (left != Ast::NONE && ast[left].kind == ASTNodeKind::Identifier) {
+                NameId name = ast[left].a;
+                NodeId value = parse_assignment();
+                // assigns the variable in scope, a first assignment declares
+                if (!ctx.sema.lookup(name))
+                    ctx.sema.declare_variable(name, L"auto", std::nullopt);
+                return node(ASTNodeKind::Assign, name, value);
             }
         }
         return left;
     }
 
-    ASTNodePtr parse_binary(int prec = 0) {
-        auto left = parse_unary();
+    NodeId parse_binary(int prec = 0) {
+        NodeId left = parse_unary();
         while (true) {
             int curr_prec = get_precedence(peek().kind);
             if (curr_prec < prec)
                 break;
-            auto op_token = advance();
-            auto right = parse_binary(curr_prec + 1);
-            left = std::make_shared<Binary>(op_token.value, left, right);
+            Lexer::TokenKind op = advance().kind;
+            NodeId right = parse_binary(curr_prec + 1);
+            left = node(ASTNodeKind::Binary, left, right, 0, op);
         }
         return left;
     }
 
-    ASTNodePtr parse_unary() {
-        if (peek().kind == Lexer::TokenKind::NOT ||
-            peek().kind == Lexer::TokenKind::SUB) {
-            auto op = advance().value;
-            auto operand = parse_unary();
-            return std::make_shared<Unary>(op, operand);
+    NodeId parse_unary() {
+        Lexer::TokenKind op = peek().kind;
+        if (op == Lexer::TokenKind::NOT || op == Lexer::TokenKind::SUB) {
+            advance();
+            NodeId operand = parse_unary();
+            return node(ASTNodeKind::Unary, operand, 0, 0, op);
         }
         return parse_primary();
     }
 
-    ASTNodePtr parse_primary() {
-        if (check(Lexer::TokenKind::NUMBER)) {
-            auto val = advance().value;
-            return std::make_shared<Number>(val);
+    NodeId parse_primary() {
+        switch (peek().kind) {
+        case Lexer::TokenKind::NUMBER: {
+            const Lexer::Token &token = advance();
+            if (token.flags & Lexer::Token::MALFORMED)
+                ctx.sema.report_error(L"Number literal out of range: " +
+                                      text(token));
+            return node(ASTNodeKind::Number, ast.number(src.literal(token)));
         }
-        if (check(Lexer::TokenKind::STRING)) {
-            auto val = advance().value;
-            return std::make_shared<String>(val);
+        case Lexer::TokenKind::STRING: {
+            const Lexer::Token &token = advance();
+            string &buffer = ast.text();
+            usize offset = buffer.size();
+            src.append_value(token, buffer);
+            return node(ASTNodeKind::String, static_cast<u32>(offset),
+                        static_cast<u32>(buffer.size() - offset));
         }
-        if (check(Lexer::TokenKind::IDENTIFIER)) {
-            auto name = advance().value;
-            if (check(Lexer::TokenKind::OPEN_PAREN)) {
-                advance();
-                std::vector<ASTNodePtr> args;
-                if (!check(Lexer::TokenKind::CLOSE_PAREN)) {
-                    do {
-                        args.push_back(parse_expression());
-                    } while (match(Lexer::TokenKind::COMMA));
-                }
-                match(Lexer::TokenKind::CLOSE_PAREN);
-                return std::make_shared<Call>(name, args);
+        case Lexer::TokenKind::IDENTIFIER: {
+            NameId name = advance().id;
+            if (!match(Lexer::TokenKind::OPEN_PAREN))
+                return node(ASTNodeKind::Identifier, name);
+            usize mark = scratch.size();
+            if (!check(Lexer::TokenKind::CLOSE_PAREN)) {
+                do {
+                    scratch.push_back(parse_expression());
+                } while (match(Lexer::TokenKind::COMMA));
             }
-            return std::make_shared<Identifier>(name);
+            match(Lexer::TokenKind::CLOSE_PAREN);
+            return node(ASTNodeKind::Call, name, take_list(mark));
         }
-        if (match(Lexer::TokenKind::OPEN_PAREN)) {
-            auto expr = parse_expression();
+        case Lexer::TokenKind::OPEN_PAREN: {
+            advance();
+            NodeId expr = parse_expression();
             match(Lexer::TokenKind::CLOSE_PAREN);
             return expr;
         }
-        return nullptr;
+        default:
+            return Ast::NONE;
+        }
     }
 
     int get_precedence(Lexer::TokenKind kind) {
@@ -289,7 +398,8 @@ class Parser {
         case Lexer::TokenKind::MOD:
             return 6;
         default:
-            return 0;
+            // not a binary operator, ends the expression
+            return -1;
         }
     }
 };
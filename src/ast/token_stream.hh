@@ -0,0 +1,249 @@
+#ifndef __TOKEN_STREAM_HH__
+#define __TOKEN_STREAM_HH__
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include "lexer/tokens.hh"
+#include "types/gen.hh"
+#include "types/rints.hh"
+
+/// \brief A bounded single-producer single-consumer queue of tokens.
+/// \details Lets a lexer running on another thread feed a parser. `push`
+///          blocks while the queue is full and `pop` while it is empty; either
+///          side may `close` the channel, after which the producer's pushes
+///          are dropped and the consumer drains what is left.
+class TokenChannel {
+  public:
+    explicit TokenChannel(usize capacity = 1 << 12)
+        : mask(std::bit_ceil(std::max<usize>(capacity, 2)) - 1)
+        , ring(new Lexer::Token[mask + 1]) {}
+
+    TokenChannel(const TokenChannel &) = delete;
+    TokenChannel &operator=(const TokenChannel &) = delete;
+
+    /// Producer. Returns false once the channel was closed.
+    bool push(std::span<const Lexer::Token> tokens) {
+        while (!tokens.empty()) {
+            u64 h = head.load(std::memory_order_acquire);
+            if (h & CLOSED) {
+                return false;
+            }
+            u64 t = tail.load(std::memory_order_relaxed) & ~CLOSED;
+            usize room = mask + 1 - static_cast<usize>(t - h);
+            if (room == 0) {
+                head.wait(h, std::memory_order_acquire);
+                continue;
+            }
+
+            usize n = std::min(room, tokens.size());
+            for (usize i = 0; i < n; ++i) {
+                ring[(t + i) & mask] = tokens[i];
+            }
+            tokens = tokens.subspan(n);
+            // an add keeps the closed bit if the consumer closed meanwhile
+            tail.fetch_add(n, std::memory_order_release);
+            tail.notify_one();
+        }
+        return true;
+    }
+
+    /// Either side. Idempotent.
+    void close() {
+        head.fetch_or(CLOSED, std::memory_order_release);
+        tail.fetch_or(CLOSED, std::memory_order_release);
+        tail.notify_all();
+        head.notify_all();
+    }
+
+    /// Consumer. Blocks until at least one token is available, returns 0
+    /// once the channel is closed and empty.
+    usize pop(std::span<Lexer::Token> out) {
+        u64 h = head.load(std::memory_order_relaxed) & ~CLOSED;
+        for (;;) {
+            u64 t = tail.load(std::memory_order_acquire);
+            usize ready = static_cast<usize>((t & ~CLOSED) - h);
+            if (ready == 0) {
+                if (t & CLOSED) {
+                    return 0;
+                }
+                tail.wait(t, std::memory_order_acquire);
+                continue;
+            }
+
+            usize n = std::min(ready, out.size());
+            for (usize i = 0; i < n; ++i) {
+                out[i] = ring[(h + i) & mask];
+            }
+            head.fetch_add(n, std::memory_order_release);
+            head.notify_one();
+            return n;
+        }
+    }
+
+  private:
+    static constexpr u64 CLOSED = 1ULL << 63;
+
+    const usize mask;
+    std::unique_ptr<Lexer::Token[]> ring;
+    alignas(64) std::atomic<u64> head{0};  // next token to pop
+    alignas(64) std::atomic<u64> tail{0};  // next slot to push
+};
+
+/// \brief The parser's view of the token sequence.
+/// \details Tokens come from a borrowed, fully lexed span, from the lexer's
+///          batched generator (lexing on demand on the calling thread), or
+///          from a `TokenChannel` fed by another thread. The latter two copy
+///          tokens into a fixed window, so memory stays bounded by the
+///          lookahead instead of the file and parsing starts with the first
+///          batch. Past the end every peek yields an `END_OF_FILE` token.
+///
+///          Inspecting tokens never copies or allocates: `peek` and `advance`
+///          hand out references into the span or the window, and a span is
+///          addressed like a window that never wraps, so the common case is
+///          one compare and one masked load.
+class TokenStream {
+  public:
+    static constexpr usize WINDOW = 1 << 8;
+
+    using Batches = generator<std::span<const Lexer::Token>>;
+
+    explicit TokenStream(std::span<const Lexer::Token> tokens)
+        : mode(SPAN)
+        , base(tokens.data())
+        , mask(~usize{0})
+        , filled(tokens.size()) {
+        if (!tokens.empty()) {
+            eof = end_of(tokens.back());
+        }
+    }
+
+    explicit TokenStream(Batches batches)
+        : mode(GENERATOR)
+        , batches(std::move(batches))
+        , window(new Lexer::Token[WINDOW])
+        , base(window.get()) {}
+
+    explicit TokenStream(TokenChannel &channel)
+        : mode(CHANNEL)
+        , channel(&channel)
+        , window(new Lexer::Token[WINDOW])
+        , base(window.get()) {}
+
+    TokenStream(TokenStream &&) = default;
+    TokenStream &operator=(TokenStream &&) = default;
+
+    /// The token `offset` places ahead, `offset < WINDOW`. The reference is
+    /// valid until the next `advance`.
+    const Lexer::Token &peek(usize offset = 0) {
+        if (offset < filled - head) [[likely]] {
+            return base[(head + offset) & mask];
+        }
+        return peek_more(offset);
+    }
+
+    const Lexer::Token &advance() {
+        if (head < filled) [[likely]] {
+            return base[head++ & mask];
+        }
+        const Lexer::Token &token = peek_more(0);
+        if (head < filled) {
+            ++head;
+        }
+        return token;
+    }
+
+    bool check(Lexer::TokenKind kind) { return peek().kind == kind; }
+
+    /// Number of tokens consumed so far.
+    usize position() const { return head; }
+
+    /// Number of tokens received so far.
+    usize received() const { return filled; }
+
+  private:
+    enum Mode : u8 { SPAN, GENERATOR, CHANNEL };
+
+    Mode mode;
+    Batches batches;
+    Batches::iterator batch_it;
+    std::span<const Lexer::Token> batch;
+    bool started = false;
+    TokenChannel *channel = nullptr;
+    std::unique_ptr<Lexer::Token[]> window;
+    const Lexer::Token *base = nullptr;  // the span, or the window
+    usize mask = WINDOW - 1;             // all ones for a span
+    usize head = 0;    // index of the next token
+    usize filled = 0;  // index one past the last token received
+    bool done = false;
+    Lexer::Token eof{Lexer::TokenKind::END_OF_FILE};
+
+    // the slow half of `peek`: refill until `offset` is available
+    const Lexer::Token &peek_more(usize offset) {
+        while (filled - head <= offset) {
+            if (!fill()) {
+                return eof;
+            }
+        }
+        return base[(head + offset) & mask];
+    }
+
+    // pull more tokens into the window, false once the source is exhausted
+    bool fill() {
+        if (mode == SPAN || done) {
+            return false;
+        }
+
+        // the free part of the window that is contiguous in memory
+        usize at = filled & (WINDOW - 1);
+        usize room = std::min(WINDOW - (filled - head), WINDOW - at);
+        if (room == 0) {
+            return false;
+        }
+        std::span<Lexer::Token> out(window.get() + at, room);
+
+        usize n = 0;
+        if (mode == CHANNEL) {
+            n = channel->pop(out);
+        } else {
+            while (batch.empty()) {
+                if (started) {
+                    ++batch_it;
+                } else {
+                    batch_it = batches.begin();
+                    started = true;
+                }
+                if (batch_it == batches.end()) {
+                    break;
+                }
+                batch = *batch_it;
+            }
+            n = std::min(batch.size(), out.size());
+            std::copy_n(batch.begin(), n, out.begin());
+            batch = batch.subspan(n);
+        }
+
+        if (n == 0) {
+            done = true;
+            return false;
+        }
+        filled += n;
+        eof = end_of(window[(filled - 1) & (WINDOW - 1)]);
+        return true;
+    }
+
+    // the token to yield past `last`
+    static Lexer::Token end_of(const Lexer::Token &last) {
+        if (last.kind == Lexer::TokenKind::END_OF_FILE) {
+            return last;
+        }
+        return Lexer::Token(Lexer::TokenKind::END_OF_FILE, last.end(), 0,
+                            last.file);
+    }
+};
+
+#endif  // __TOKEN_STREAM_HH__
@@ -0,0 +1,195 @@
+#include "driver/cache.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "vm/serialize.hh"
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr char MAGIC[4] = {'C', 'S', 'C', '\0'};
+
+u64 mix(u64 hash, u64 word) {
+    hash = (hash ^ word) * 0xBF58476D1CE4E5B9ULL;
+    return hash ^ hash >> 31;
+}
+
+// eight bytes per step, sources are hashed whole on every lookup
+u64 hash_bytes(std::string_view bytes, u64 seed) {
+    u64 hash = mix(seed, bytes.size());
+    usize i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        u64 word;
+        std::memcpy(&word, bytes.data() + i, 8);
+        hash = mix(hash, word);
+    }
+    u64 tail = 0;
+    std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+    return mix(hash, tail);
+}
+
+std::optional<std::string> read_all(const fs::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return std::nullopt;
+    std::ostringstream bytes;
+    bytes << in.rdbuf();
+    return std::move(bytes).str();
+}
+
+// a missing file hashes to zero, so creating it invalidates too
+u64 hash_file(const fs::path &path) {
+    auto bytes = read_all(path);
+    return bytes ? hash_bytes(*bytes, 1) | 1 : 0;
+}
+
+template <typename T>
+void put(std::ostream &out, T value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool get(std::istream &in, T &value) {
+    return static_cast<bool>(
+        in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+// unique per process and thread, so writers never share a temporary
+fs::path temporary_for(const fs::path &path) {
+    static std::atomic<u64> serial = 0;
+    u64 unique = mix(std::hash<std::thread::id>()(std::this_thread::get_id()),
+                     static_cast<u64>(std::chrono::steady_clock::now()
+                                          .time_since_epoch()
+                                          .count()) +
+                         serial.fetch_add(1, std::memory_order_relaxed));
+    fs::path tmp = path;
+    return tmp += ".tmp" + std::to_string(unique);
+}
+}  // namespace
+
+fs::path BytecodeCache::default_dir() {
+    if (const char *dir = std::getenv("C_SET_CACHE"); dir && *dir)
+        return dir;
+    if (const char *dir = std::getenv("XDG_CACHE_HOME"); dir && *dir)
+        return fs::path(dir) / "c-set";
+    if (const char *home = std::getenv("HOME"); home && *home)
+        return fs::path(home) / ".cache" / "c-set";
+    if (const char *local = std::getenv("LOCALAPPDATA"); local && *local)
+        return fs::path(local) / "c-set";
+    std::error_code ec;
+    return fs::temp_directory_path(ec) / "c-set";
+}
+
+BytecodeCache::Key BytecodeCache::key(const fs::path &source,
+                                      std::wstring_view text) const {
+    // the path is part of the key, imports resolve relative to it
+    std::error_code ec;
+    std::string path = fs::absolute(source, ec).lexically_normal().string();
+    u64 hash = hash_bytes(path, COMPILER_VERSION);
+    hash = mix(hash, BYTECODE_VERSION);
+    hash = mix(hash, options);
+    return hash_bytes(std::string_view(reinterpret_cast<const char *>(
+                                           text.data()),
+                                       text.size() * sizeof(wchar_t)),
+                      hash);
+}
+
+fs::path BytecodeCache::entry(Key key) const {
+    char name[17];
+    for (int i = 15; i >= 0; --i, key >>= 4)
+        name[i] = "0123456789abcdef"[key & 15];
+    name[16] = '\0';
+    // two levels, so no directory grows too large
+    return dir / std::string_view(name, 2) / (std::string(name + 2) + ".csb");
+}
+
+bool BytecodeCache::load(Key key, Bytecode &code, usize &globals) const {
+    // lengths in the entry are checked against its size, and anything
+    // thrown still only makes a miss
+    try {
+        fs::path path = entry(key);
+        std::error_code ec;
+        u64 size = fs::file_size(path, ec);
+        if (ec)
+            return false;
+
+        std::ifstream in(path, std::ios::binary);
+        char magic[sizeof(MAGIC)];
+        u64 stored;
+        u32 count;
+        if (!in.read(magic, sizeof(magic)) ||
+            std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            !get(in, stored) || stored != key || !get(in, count))
+            return false;
+
+        for (u32 i = 0; i < count; ++i) {
+            u32 length;
+            u64 hash;
+            if (!get(in, length) || length > size)
+                return false;
+            std::string import(length, '\0');
+            if (!in.read(import.data(), length) || !get(in, hash) ||
+                hash_file(import) != hash)
+                return false;
+        }
+        return read_bytecode(in, code, globals);
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+void BytecodeCache::store(Key key, const std::vector<fs::path> &imports,
+                          const Bytecode &code, usize globals) const {
+    fs::path path = entry(key);
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+
+    fs::path tmp = temporary_for(path);
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(MAGIC, sizeof(MAGIC));
+        put<u64>(out, key);
+        put<u32>(out, static_cast<u32>(imports.size()));
+        for (const fs::path &import : imports) {
+            std::string name =
+                fs::absolute(import, ec).lexically_normal().string();
+            put<u32>(out, static_cast<u32>(name.size()));
+            out.write(name.data(), static_cast<std::streamsize>(name.size()));
+            put<u64>(out, hash_file(import));
+        }
+        write_bytecode(out, code, globals);
+        if (!out.flush()) {
+            out.close();
+            fs::remove(tmp, ec);
+            return;
+        }
+    }
+    // readers see the old entry or the new one, never a partial file
+    fs::rename(tmp, path, ec);
+    if (ec)
+        fs::remove(tmp, ec);
+}
+
+std::vector<fs::path> imports_of(const Ast &ast, const Interner &names,
+                                 const fs::path &source) {
+    std::vector<fs::path> imports;
+    if (ast.root == Ast::NONE)
+        return imports;
+    for (NodeId stmt : ast.list(ast[ast.root].a)) {
+        if (ast[stmt].kind != ASTNodeKind::Import)
+            continue;
+        fs::path module = source.parent_path() / names.view(ast[stmt].a);
+        imports.push_back(module += ".cs");
+    }
+    return imports;
+}
@@ -0,0 +1,65 @@
+#ifndef __CACHE_HH__
+#define __CACHE_HH__
+
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "ast/ast.hh"
+#include "types/intern.hh"
+#include "types/rints.hh"
+#include "vm/bytecode.hh"
+
+// bump whenever the front end or code generation emits different
+// bytecode for the same source
+constexpr u32 COMPILER_VERSION = 4;
+
+/// \brief A directory of compiled bytecode, keyed by what produced it.
+/// \details An entry is found by a hash of the source text, the compiler
+///          and bytecode versions and the options that change the output,
+///          so an edited file, a new compiler or other flags simply miss.
+///          Each entry also lists the files the source imports with a hash
+///          of their contents; a changed, new or deleted import turns the
+///          entry into a miss. Entries are written to a temporary file and
+///          renamed into place, so concurrent compilers never read half an
+///          entry. Every failure to read or write is a miss, never an error.
+class BytecodeCache {
+  public:
+    using Key = u64;
+
+    /// \param options Flags that change the generated code, see
+    ///                `CompileOptions`.
+    BytecodeCache(std::filesystem::path dir, u64 options)
+        : dir(std::move(dir))
+        , options(options) {}
+
+    /// `$C_SET_CACHE`, else `c-set` in the user's cache directory.
+    static std::filesystem::path default_dir();
+
+    /// The key of `source` given the decoded `text` it is compiled from.
+    /// Hash what the lexer reads, not the file again, or an edit in
+    /// between stores the new bytecode under the old contents.
+    Key key(const std::filesystem::path &source, std::wstring_view text) const;
+
+    /// False on a miss, including an entry that is missing, corrupt or
+    /// out of date; never throws.
+    bool load(Key key, Bytecode &code, usize &globals) const;
+
+    /// \param imports The files `source` imports, see `imports_of`.
+    void store(Key key, const std::vector<std::filesystem::path> &imports,
+               const Bytecode &code, usize globals) const;
+
+  private:
+    std::filesystem::path dir;
+    u64 options;
+
+    std::filesystem::path entry(Key key) const;
+};
+
+/// The files the imports of a parsed program refer to: `import name;`
+/// names `name.cs` next to the importing source.
+std::vector<std::filesystem::path>
+imports_of(const Ast &ast, const Interner &names,
+           const std::filesystem::path &source);
+
+#endif  // __CACHE_HH__
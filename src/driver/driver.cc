@@ -0,0 +1,325 @@
+#include "driver/driver.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "ast/ast.hh"
+#include "ast/parser.hh"
+#include "ast/token_stream.hh"
+#include "driver/cache.hh"
+#include "lexer/lexer.hh"
+#include "sema/infer.hh"
+#include "sema/resolve.hh"
+#include "thread/coro.hh"
+#include "thread/pool.hh"
+#include "thread/task_graph.hh"
+#include "thread/worker.hh"
+#include "types/intern.hh"
+#include "vm/codegen.hh"
+#include "vm/optimize.hh"
+#include "vm/serialize.hh"
+
+namespace fs = std::filesystem;
+
+namespace {
+struct Unit {
+    fs::path source;
+    fs::path artifact;
+};
+
+struct Outcome {
+    std::vector<std::wstring> diagnostics;
+    usize generated = 0;  // before `optimize`
+    usize instructions = 0;
+    bool ok = false;
+    bool cached = false;
+};
+
+std::wstring widen(const std::string &text) {
+    return std::wstring(text.begin(), text.end());
+}
+
+fs::path artifact_of(const fs::path &relative, const CompileOptions &options,
+                     const fs::path &source) {
+    fs::path out =
+        options.out_dir.empty() ? source : options.out_dir / relative;
+    return out.replace_extension(".csb");
+}
+
+std::vector<Unit> collect(const std::vector<fs::path> &inputs,
+                          const CompileOptions &options,
+                          std::vector<std::wstring> &errors) {
+    std::vector<Unit> units;
+    for (const fs::path &input : inputs) {
+        std::error_code ec;
+        if (fs::is_directory(input, ec)) {
+            std::vector<fs::path> found;
+            for (const auto &entry :
+                 fs::recursive_directory_iterator(input, ec)) {
+                if (entry.is_regular_file() &&
+                    entry.path().extension() == ".cs")
+                    found.push_back(entry.path());
+            }
+            // directory order is arbitrary, keep the output stable
+            std::sort(found.begin(), found.end());
+            for (fs::path &source : found) {
+                fs::path artifact = artifact_of(
+                    source.lexically_relative(input), options, source);
+                units.push_back({std::move(source), std::move(artifact)});
+            }
+        } else if (fs::is_regular_file(input, ec)) {
+            units.push_back(
+                {input, artifact_of(input.filename(), options, input)});
+        } else {
+            errors.push_back(input.wstring() + L": No such file or directory");
+        }
+    }
+    return units;
+}
+
+bool write_artifact(const Unit &unit, const Bytecode &code, usize globals,
+                    Outcome &outcome) {
+    std::error_code ec;
+    fs::create_directories(unit.artifact.parent_path(), ec);
+    std::ofstream out(unit.artifact, std::ios::binary | std::ios::trunc);
+    write_bytecode(out, code, globals);
+    if (!out.flush()) {
+        outcome.diagnostics.push_back(L"Cannot write " +
+                                      unit.artifact.wstring());
+        return false;
+    }
+    outcome.instructions = code.size();
+    outcome.ok = true;
+    return true;
+}
+
+// every worker keeps one tree and reuses its capacity file after file
+Ast &arena() {
+    thread_local Ast tree;
+    return tree;
+}
+
+// one file on its way through the stages, each a task of its own
+struct Job {
+    Job(const Unit &unit, u16 file, ThreadPool &pool, Interner &names,
+        const CompileOptions &options,
+        const std::optional<BytecodeCache> &cache)
+        : unit(unit)
+        , names(names)
+        , options(options)
+        , cache(cache)
+        , lexer(unit.source.wstring(), &pool, &names, file)
+        , ctx(names) {}
+
+    const Unit &unit;
+    const Interner &names;
+    const CompileOptions &options;
+    const std::optional<BytecodeCache> &cache;
+    Lexer::Lexer<ThreadPool> lexer;
+    ParserContext ctx;
+    std::optional<Parser> parser;
+    std::optional<Resolver> resolver;
+    std::optional<TypeInference> types;
+    std::optional<BytecodeCache::Key> key;
+    Bytecode code;
+    usize globals = 0;
+    Outcome outcome;
+    bool done = false;  // failed, or found in the cache
+};
+
+using JobPtr = std::shared_ptr<Job>;
+
+// read the source; the cache key hashes exactly the text lexed later
+void read(Job &job) {
+    if (!job.lexer.open()) {
+        job.outcome.diagnostics.push_back(L"Cannot read file");
+        job.done = true;
+        return;
+    }
+    if (!job.cache)
+        return;
+    job.key = job.cache->key(job.unit.source, job.lexer.source().view());
+    if (job.cache->load(*job.key, job.code, job.globals)) {
+        job.outcome.cached = true;
+        job.done = true;
+    }
+}
+
+// lex and parse, streamed into each other; `Sema` runs while parsing
+void parse(Job &job) {
+    if (job.done)
+        return;
+    job.ctx.lazy_bodies = job.options.lazy;
+    job.ctx.ast = std::move(arena());
+    job.parser.emplace(TokenStream(job.lexer.tokenize_batched()),
+                       job.lexer.source(), job.ctx);
+    job.parser->parse_program();
+    job.done = job.ctx.sema.has_errors();
+}
+
+void check(Job &job) {
+    if (job.done)
+        return;
+    job.resolver.emplace(job.ctx.ast);
+    job.types.emplace(job.ctx.ast);
+    job.resolver->resolve();
+    job.types->infer();
+}
+
+// bodies skipped by the parser go through the earlier stages here, once
+// something calls them
+void generate(Job &job) {
+    if (job.done)
+        return;
+    CodeGen codegen(job.names);
+    codegen.expand = [&](NodeId func) {
+        NodeId body = job.parser->parse_body(func);
+        job.resolver->resolve_function(func);
+        job.types->infer_function(func);
+        return body;
+    };
+    try {
+        job.code = codegen.generate(job.ctx.ast);
+    } catch (const std::exception &ex) {
+        job.outcome.diagnostics.push_back(L"Code generation error: " +
+                                          widen(ex.what()));
+    }
+    job.done = !job.outcome.diagnostics.empty() || job.ctx.sema.has_errors();
+    if (job.done)
+        return;
+    job.globals = codegen.globals;
+    job.outcome.generated = job.code.size();
+    optimize(job.code, job.options.opt_level);
+}
+
+Outcome write(Job &job) {
+    for (const std::wstring &message : job.ctx.sema.messages())
+        job.outcome.diagnostics.push_back(L"Semantic error: " + message);
+    if (job.outcome.diagnostics.empty()) {
+        if (job.key && !job.outcome.cached)
+            job.cache->store(*job.key,
+                             imports_of(job.ctx.ast, job.names,
+                                        job.unit.source),
+                             job.code, job.globals);
+        write_artifact(job.unit, job.code, job.globals, job.outcome);
+    }
+    if (job.parser) {
+        arena() = std::move(job.ctx.ast);
+        arena().clear();
+    }
+    return std::move(job.outcome);
+}
+
+// a stage as the body of a task that hands the job on to the next one
+template <void (*Stage)(Job &)>
+JobPtr step(const JobPtr &job) {
+    Stage(*job);
+    return job;
+}
+
+// read on `io`, off the pool, then queue the rest of the stages there
+lazy<Future<Outcome>> begin(JobPtr job, Executor io, TaskGraph &graph) {
+    auto fn = [&job] { read(*job); };
+    try {
+        co_await offload(io, fn);
+    } catch (const std::exception &ex) {
+        job->outcome.diagnostics.push_back(widen(ex.what()));
+        job->done = true;
+    }
+    co_return graph.spawn([job] { return step<parse>(job); })
+        .then(step<check>)
+        .then(step<generate>)
+        .then([](const JobPtr &job) { return write(*job); });
+}
+}  // namespace
+
+usize compile_all(const std::vector<fs::path> &inputs,
+                  const CompileOptions &options) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::wstring> errors;
+    std::vector<Unit> units = collect(inputs, options, errors);
+    for (const std::wstring &error : errors)
+        std::wcerr << error << std::endl;
+
+    // a token names its file in 16 bits, so more would share an id
+    constexpr usize MAX_FILES = usize{UINT16_MAX} + 1;
+    if (units.size() > MAX_FILES) {
+        std::wcerr << L"Too many input files: " << units.size()
+                   << L", at most " << MAX_FILES << L" per run" << std::endl;
+        return units.size() + errors.size();
+    }
+
+    usize jobs = options.jobs;
+    if (jobs == 0)
+        jobs = std::max(1U, std::thread::hardware_concurrency());
+    ThreadPool pool(jobs);
+    Interner names;
+    TaskGraph graph(pool);
+    std::optional<BytecodeCache> cache;
+    if (!options.cache_dir.empty())
+        cache.emplace(options.cache_dir, codegen_flags(options));
+
+    // one thread does every read, handing each file to the pool as soon as
+    // it is in memory
+    WorkerThread io;
+    std::vector<lazy<Future<Outcome>>> reads;
+    reads.reserve(units.size());
+    for (usize i = 0; i < units.size(); ++i) {
+        auto job = std::make_shared<Job>(units[i], static_cast<u16>(i), pool,
+                                         names, options, cache);
+        reads.push_back(begin(std::move(job), Executor(io), graph));
+    }
+    std::vector<Future<Outcome>> outcomes =
+        sync_wait(when_all(std::move(reads)));
+
+    usize failed = errors.size();
+    usize cached = 0;
+    for (usize i = 0; i < units.size(); ++i) {
+        std::vector<std::wstring> diagnostics;
+        bool hit = false;
+        usize generated = 0, instructions = 0;
+        try {
+            const Outcome &outcome = outcomes[i].get();
+            diagnostics = outcome.diagnostics;
+            hit = outcome.cached;
+            generated = outcome.generated;
+            instructions = outcome.instructions;
+        } catch (const std::exception &ex) {
+            diagnostics.push_back(widen(ex.what()));
+        }
+        if (diagnostics.empty()) {
+            std::wcout << units[i].source.wstring() << L" -> "
+                       << units[i].artifact.wstring();
+            if (hit)
+                std::wcout << L" (cached)";
+            else
+                std::wcout << L" (" << generated << L" -> " << instructions
+                           << L" instructions)";
+            std::wcout << std::endl;
+            cached += hit;
+            continue;
+        }
+        ++failed;
+        for (const std::wstring &message : diagnostics)
+            std::wcerr << units[i].source.wstring() << L": " << message
+                       << std::endl;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::wcout << L"Compiled " << units.size() + errors.size() - failed
+               << L" of " << units.size() + errors.size() << L" files ("
+               << cached << L" cached) in "
+               << elapsed.count() << L" ms on " << pool.size()
+               << L" threads." << std::endl;
+    return failed;
+}
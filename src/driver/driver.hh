@@ -0,0 +1,41 @@
+#ifndef __DRIVER_HH__
+#define __DRIVER_HH__
+
+#include <filesystem>
+#include <vector>
+
+#include "types/rints.hh"
+
+struct CompileOptions {
+    std::filesystem::path out_dir;  // next to each source when empty
+    usize jobs = 0;                 // worker threads, 0 for one per core
+    bool lazy = false;              // see `ParserContext::lazy_bodies`
+    unsigned opt_level = 2;         // see `optimize`
+    std::filesystem::path cache_dir;  // no caching when empty
+};
+
+/// The options that change the generated code, as `BytecodeCache` flags.
+inline u64 codegen_flags(const CompileOptions &options) {
+    return (options.lazy ? 1 : 0) | u64{options.opt_level} << 1;
+}
+
+/// \brief Compile many sources to `.csb` bytecode files at once.
+/// \details Directories are searched recursively for `.cs` files. Sources
+///          are read one after another on an I/O thread through `offload`;
+///          each file read goes on through a chain of dependent tasks on a
+///          `TaskGraph`: lex and parse, resolve and infer, generate and
+///          optimize, write. Stages of different files overlap on the pool
+///          and with the reads; the tree is built in an arena the parsing
+///          worker reuses, and all files share one `Interner`. Diagnostics
+///          are printed in input order, so the output does not depend on
+///          scheduling, each with its instruction count before and after
+///          `optimize`. With an output directory, the layout below a
+///          directory input is kept. With a cache directory, files found in
+///          the `BytecodeCache` go straight from the read to the write.
+///          Tokens name their file in 16 bits, so a run that finds more
+///          than 65536 files compiles none of them.
+/// \return The number of files that failed to compile.
+usize compile_all(const std::vector<std::filesystem::path> &inputs,
+                  const CompileOptions &options);
+
+#endif  // __DRIVER_HH__
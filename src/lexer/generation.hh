@@ -1,21 +1,19 @@
 #ifndef __GENERATION_H__
 #define __GENERATION_H__
 
-#include <tuple>
-#include <utility>
+#include <array>
+#include <stdexcept>
 
-#include "types/estr.hh"
-#include "types/key.hh"
 #include "types/rints.hh"
 
 #define ENUM_GEN(x, y) x,
 #define MAKE_ENUM(name, X) enum class name { X }
 
-#define MAP_GEN(x, y) {{Generation::hash_string<y>(), TokenKind::x}, y},
-#define MAKE_MAP(name, X) \
-    inline static const TokenMap name { X }
-
-#define HASH_MAX 0xFFFFFFFFFFFFFFFFULL
+#define LEXEME_GEN(x, y) Generation::Lexeme<TokenKind>{y, TokenKind::x},
+#define MAKE_LEXEMES(name, X)                                          \
+    inline constexpr Generation::PerfectHash<TokenKind,                \
+        std::to_array<Generation::Lexeme<TokenKind>>({X}).size()> name{ \
+        std::to_array<Generation::Lexeme<TokenKind>>({X})}
 
 namespace Lexer {
 namespace Generation {
@@ -27,55 +25,97 @@ namespace Generation {
         return len;
     }
 
-    constexpr u64 get_char_hash(const wchar_t chr, usize pos, u64 hash = 0) {
-        return (((static_cast<u64>(chr) << ((pos & 7) + 1)) |
-                 (static_cast<u64>(chr) >> ((pos & 3) + 1))) ^
-                pos) ^
-               (hash << 1) ^ (hash >> 3);
-    }
-
-    template <const usize N>
-    consteval u64 hash_string(const wchar_t *str) {
-        static_assert(N <= 256, "String too long for hashing");
-        u64 hash = 0;
-
-        (void)[&]<usize... I>(const wchar_t *s, std::index_sequence<I...>) {
-            ((hash ^= get_char_hash(s[I], I, hash)), ...);
+    template <typename Kind>
+    struct Lexeme {
+        const wchar_t *text;
+        Kind kind;
+    };
+
+    /// \brief A collision-free hash over a fixed set of lexemes.
+    /// \details The seed is searched for at compile time so that every
+    ///          non-empty lexeme lands in its own slot. A lookup is a single
+    ///          probe on (first, middle, last, length) followed by a length
+    ///          and content check against the one candidate in that slot.
+    template <typename Kind, const usize N>
+    class PerfectHash {
+      public:
+        static constexpr usize SLOTS = 256;
+        static constexpr u8 EMPTY = 0xFF;
+        static_assert(N < EMPTY, "Too many lexemes for a u8 slot table");
+
+        consteval PerfectHash(const std::array<Lexeme<Kind>, N> &lexemes)
+            : lexemes(lexemes) {
+            for (usize i = 0; i < N; ++i) {
+                lengths[i] = evaluated_str_length(lexemes[i].text);
+                max_length = lengths[i] > max_length ? lengths[i] : max_length;
+            }
+
+            for (seed = 1; seed < 0x10000; ++seed) {
+                if (place()) {
+                    return;
+                }
+            }
+
+            throw std::logic_error("No perfect hash seed for lexemes");
         }
 
-        (str, std::make_index_sequence<N>{});
-
-        return hash & HASH_MAX;
-    }
-
-    u64 hash_string(const string &str) {
-        if (str.length() >= 256) {
-            throw std::runtime_error("String too long for hashing");
+        constexpr Kind lookup(const wchar_t *str, usize len,
+                              Kind fallback) const {
+            if (len == 0 || len > max_length) {
+                return fallback;
+            }
+
+            u8 idx = table[slot(seed, str, len)];
+            if (idx == EMPTY || lengths[idx] != len) {
+                return fallback;
+            }
+
+            const wchar_t *text = lexemes[idx].text;
+            for (usize i = 0; i < len; ++i) {
+                if (text[i] != str[i]) {
+                    return fallback;
+                }
+            }
+
+            return lexemes[idx].kind;
         }
 
-        u64 hash = 0;
-
-        for (usize i = 0; i < str.length(); ++i) {
-            hash ^= get_char_hash(str[i], i, hash);
+      private:
+        std::array<Lexeme<Kind>, N> lexemes;
+        std::array<usize, N> lengths{};
+        std::array<u8, SLOTS> table{};
+        usize max_length = 0;
+        u32 seed = 0;
+
+        static constexpr usize slot(u32 seed, const wchar_t *str, usize len) {
+            // pack (first, middle, last, length) into one word; characters
+            // outside latin-1 may alias, the content check rejects those
+            u32 hash = (static_cast<u32>(str[0]) & 0xFF) |
+                       (static_cast<u32>(str[len >> 1]) & 0xFF) << 8 |
+                       (static_cast<u32>(str[len - 1]) & 0xFF) << 16 |
+                       static_cast<u32>(len) << 24;
+            hash = (hash ^ seed) * 0x9E3779B1U;
+            hash ^= hash >> 15;
+            hash *= 0x85EBCA6BU;
+            hash ^= hash >> 13;
+            return hash & (SLOTS - 1);
         }
 
-        return hash & HASH_MAX;
-    }
-
-    template <const EvaluatedString str>
-    consteval u64 hash_string() {
-        return hash_string<evaluated_str_length(str.value.data())>(
-            str.value.data());
-    }
-
-    template <const EvaluatedString str>
-    consteval std::tuple<u64, const wchar_t *> make_mapping_value() {
-        if constexpr (evaluated_str_length(str.value.data()) == 0) {
-            return {HASH_MAX, L""};
+        consteval bool place() {
+            table.fill(EMPTY);
+            for (usize i = 0; i < N; ++i) {
+                if (lengths[i] == 0) {
+                    continue;
+                }
+                usize at = slot(seed, lexemes[i].text, lengths[i]);
+                if (table[at] != EMPTY) {
+                    return false;
+                }
+                table[at] = static_cast<u8>(i);
+            }
+            return true;
         }
-
-        return {hash_string<str>(), str.value.data()};
-    }
+    };
 }  // namespace Generation
 }  // namespace Lexer
 
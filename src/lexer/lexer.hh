@@ -1,39 +1,65 @@
 #ifndef __LEX_H__
 #define __LEX_H__
 
+#include <algorithm>
+#include <charconv>
 #include <coroutine>
-#include <fstream>
 #include <iostream>
-#include <print>
+#include <latch>
+#include <span>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "lexer/generation.hh"
 #include "lexer/lexemes.hh"
+#include "lexer/scan.hh"
+#include "lexer/source.hh"
 #include "lexer/tokens.hh"
 #include "thread/thread.hh"
-#include "types/estr.hh"
 #include "types/gen.hh"
+#include "types/intern.hh"
 #include "types/rints.hh"
 
 namespace Lexer {
 using TokenList = std::vector<Token>;
 
+/// A change to a source buffer: `removed` characters at `offset` (in the old
+/// buffer) were replaced by `inserted` characters.
+struct Edit {
+    u32 offset;
+    u32 removed;
+    u32 inserted;
+};
+
 template <typename ThreadManager>
     requires WorkerThreadConcept<ThreadManager>
 class Lexer {
   private:
-    std::wifstream file;
+    Source src;
     const string filename;
     TokenList tokens;
-    usize offset = 0;
     ThreadManager *worker;
+    Interner *names;
+    const Scan::Scanners *scan = &Scan::scanners();
+    u16 file;
+
+    // below this many characters per chunk a file is not worth splitting
+    static constexpr usize MIN_CHUNK = 1 << 18;
+
+    // `next` may read up to `end + LOOKAHEAD` to end a token; for `1,234` it
+    // checks the comma, three digits and that no fourth one follows
+    static constexpr u32 LOOKAHEAD = 4;
 
   public:
-    explicit Lexer(string filename, ThreadManager *worker)
+    explicit Lexer(string filename, ThreadManager *worker, Interner *names,
+                   u16 file = 0)
         : filename(std::move(filename))
-        , worker(worker) {
-        worker->async([this] { tokens.reserve(256); });
+        , worker(worker)
+        , names(names)
+        , file(file) {
+        tokens.reserve(256);
     }
 
     Lexer(const Lexer &) = default;
@@ -44,229 +70,480 @@ class Lexer {
     TokenList &operator*() { return tokens; }
     TokenList *operator->() { return &tokens; }
 
-    ~Lexer() {
-        if (file.is_open()) {
-            file.close();
-        }
+    const Source &source() const { return src; }
 
-        if (file.fail()) {
-            std::wcerr << L"Failed to close file: " << filename << '\n';
+    /// Read the file unless it was read or `reload`ed already. The
+    /// tokenizers call this themselves; call it first to look at the exact
+    /// text they will lex.
+    bool open() {
+        if (src.ok()) {
+            return true;
+        }
+        src = Source(filename);
+        if (!src.ok()) {
+            std::wcerr << L"Failed to open file: " << filename << '\n';
+            return false;
         }
+        return true;
+    }
 
+    ~Lexer() {
         if (!tokens.empty()) {
             tokens.clear();
         }
     }
 
   public:
+    /// Token by token adapter over `tokenize_batched`.
     generator<Token> tokenize() {
-        file.open(filename);
+        for (std::span<const Token> batch : tokenize_batched()) {
+            for (const Token &token : batch) {
+                co_yield Token(token);
+            }
+        }
+    }
 
-        if (!file.is_open()) {
-            std::wcerr << L"Failed to open file: " << filename << '\n';
+    /// \brief Lex the file, yielding tokens in blocks of up to `batch`.
+    /// \details Blocks are filled in a ring of `ring` buffers, so a yielded
+    ///          span stays valid until `ring - 1` further blocks have been
+    ///          yielded. The last block ends with the `END_OF_FILE` token.
+    generator<std::span<const Token>> tokenize_batched(usize batch = 1024,
+                                                       usize ring = 2) {
+        if (!open()) {
             co_return;
         }
 
-        usize offset = 0;
-        usize line = 0;
-        usize column = 0;
-        wchar_t chr;
+        batch = std::max<usize>(batch, 1);
+        std::vector<TokenList> buffers(std::max<usize>(ring, 1));
+        for (auto &buffer : buffers) {
+            buffer.reserve(batch);
+        }
+
+        const wchar *cur = src.begin();
+        usize slot = 0;
         Token token;
-        string token_str;
-        TokenKind kind = TokenKind::END_OF_FILE;
 
-        for (offset = 0; file.peek() != EOF; ++offset) {
-            chr = file.get();
+        for (;;) {
+            TokenList &buffer = buffers[slot];
+            buffer.clear();
 
-            if (file.eof()) {
-                break;
+            bool more = true;
+            while (buffer.size() < batch && (more = next(cur, token))) {
+                buffer.push_back(token);
             }
 
-            if (chr == L'\n') {
-                line++;
-                column = 0;
-                continue;
+            if (!more) {
+                // yield eof token at the end
+                buffer.emplace_back(TokenKind::END_OF_FILE, offset(cur), 0,
+                                    file);
+                co_yield std::span<const Token>(buffer);
+                co_return;
+            }
+
+            co_yield std::span<const Token>(buffer);
+            slot = (slot + 1) % buffers.size();
+        }
+    }
+
+    /// \brief Lex the whole file in chunks spread over the worker.
+    /// \details The buffer is cut just after newlines into `chunks` pieces
+    ///          (the hardware concurrency by default) and every piece is
+    ///          lexed as if it started in the default state. A piece that
+    ///          actually begins inside a multi-line string literal is
+    ///          repaired while stitching: lexing restarts at the end of the
+    ///          straddling token and stops as soon as it lands on a token
+    ///          start the speculative pass also produced, since the lexer
+    ///          carries no state between tokens. Comments always end at a
+    ///          newline, so they never straddle a cut.
+    /// \return The complete token list, terminated by an `END_OF_FILE`.
+    TokenList tokenize_parallel(usize chunks = 0) {
+        TokenList out;
+        if (!open()) {
+            return out;
+        }
+
+        if (chunks == 0) {
+            chunks = std::max(1U, std::thread::hardware_concurrency());
+        }
+        chunks = std::clamp<usize>(src.size() / MIN_CHUNK, 1, chunks);
+
+        std::vector<const wchar *> cuts{src.begin()};
+        for (usize i = 1; i < chunks; ++i) {
+            const wchar *at = scan->line(src.begin() + src.size() * i / chunks,
+                                         src.end());
+            if (at < src.end() && ++at > cuts.back()) {
+                cuts.push_back(at);
             }
+        }
+        cuts.push_back(src.end());
 
-            // we need to do a few things here now:
-            token_str.clear();
-            token_str += chr;
-            switch (chr) {
-            case L'a' ... L'z':
-            case L'A' ... L'Z':
-            case L'_': {
-                // identifier or keyword
-                while (file.peek() != EOF) {
-                    wchar_t next = file.peek();
-                    if ((next >= L'a' && next <= L'z') ||
-                        (next >= L'A' && next <= L'Z') ||
-                        (next >= L'0' && next <= L'9') || next == L'_') {
-                        chr = file.get();
-                        token_str += chr;
-                        column++;
-                    } else {
-                        break;
-                    }
+        usize pieces = cuts.size() - 1;
+        std::vector<TokenList> lexed(pieces);
+        std::latch done(static_cast<std::ptrdiff_t>(pieces - 1));
+
+        for (usize i = 1; i < pieces; ++i) {
+            worker->async([&, i] {
+                lex_range(cuts[i], cuts[i + 1], lexed[i]);
+                done.count_down();
+            });
+        }
+        lex_range(cuts[0], cuts[1], lexed[0]);
+        done.wait();
+
+        usize total = 0;
+        for (const auto &piece : lexed) {
+            total += piece.size();
+        }
+        out.reserve(total + 1);
+
+        for (usize i = 0; i < pieces; ++i) {
+            stitch(out, lexed[i], cuts[i], cuts[i + 1]);
+        }
+
+        out.emplace_back(TokenKind::END_OF_FILE, offset(src.end()), 0, file);
+        return out;
+    }
+
+    /// Re-read the file after it changed on disk.
+    bool reload() { return src.load(); }
+
+    /// Replace the buffer with in-memory UTF-8 contents, e.g. an editor's
+    /// unsaved document.
+    void reload(std::string_view utf8) { src.assign(utf8); }
+
+    /// \brief Bring a token list up to date after the source was reloaded.
+    /// \details Lexing restarts at the end of the last token that cannot have
+    ///          been affected by any edit and runs only until it produces a
+    ///          token that starts past the edited region at the same place
+    ///          (after shifting) as an old token. From there the old tokens
+    ///          are reused with their offsets moved by the net size change.
+    /// \param tokens The complete previous token list, `END_OF_FILE`
+    ///               included.
+    /// \param edits  The changes made since `tokens` was produced, in old
+    ///               buffer offsets, non-overlapping and in any order.
+    TokenList relex(TokenList tokens, std::span<const Edit> edits) const {
+        if (edits.empty() || tokens.empty()) {
+            return tokens;
+        }
+
+        u32 lo = UINT32_MAX;
+        u32 hi = 0;
+        i64 delta = 0;
+        for (const Edit &edit : edits) {
+            lo = std::min(lo, edit.offset);
+            hi = std::max(hi, edit.offset + edit.removed);
+            delta += static_cast<i64>(edit.inserted) - edit.removed;
+        }
+        const u32 hi_new = static_cast<u32>(hi + delta);
+
+        // a number looked up to `LOOKAHEAD` characters past its end, so a
+        // token ending that close to `lo` may read differently now
+        auto first = std::lower_bound(
+            tokens.begin(), tokens.end(), lo, [](const Token &tok, u32 at) {
+                return tok.end() + LOOKAHEAD < at;
+            });
+        usize restart = first == tokens.begin() ? 0 : std::prev(first)->end();
+
+        TokenList fresh;
+        auto reuse = tokens.end();
+        const wchar *cur = src.begin() + restart;
+        Token token;
+
+        while (next(cur, token)) {
+            if (token.offset >= hi_new) {
+                u32 old = static_cast<u32>(token.offset - delta);
+                auto it = std::lower_bound(
+                    first, tokens.end(), old,
+                    [](const Token &tok, u32 at) { return tok.offset < at; });
+                if (it != tokens.end() && it->offset == old &&
+                    it->kind == token.kind && it->length == token.length &&
+                    it->flags == token.flags && it->id == token.id) {
+                    reuse = it;
+                    break;
                 }
-                usize hash = Generation::hash_string(token_str);
-                if (Token::Mapping.contains({hash})) {
-                    TokenKind kind = TokenKind::IDENTIFIER;
-                    for (const auto &[key, val] : Token::Mapping) {
-                        if (key.k1 == hash) {
-                            kind = key.k2;
-                        }
-                    }
-                    token = Token(kind, token_str, line, column,
-                                  token_str.length(), offset, filename);
-                } else {
-                    token = Token(TokenKind::IDENTIFIER, token_str, line,
-                                  column, token_str.length(), offset, filename);
+            }
+            fresh.push_back(token);
+        }
+
+        if (reuse == tokens.end()) {
+            fresh.emplace_back(TokenKind::END_OF_FILE, offset(src.end()), 0,
+                               file);
+        }
+
+        usize at = static_cast<usize>(first - tokens.begin());
+        for (auto it = reuse; it != tokens.end(); ++it) {
+            it->offset = static_cast<u32>(it->offset + delta);
+        }
+        tokens.erase(first, reuse);
+        tokens.insert(tokens.begin() + static_cast<isize>(at), fresh.begin(),
+                      fresh.end());
+
+        return tokens;
+    }
+
+  private:
+
+    // lex every token that starts in [from, stop)
+    void lex_range(const wchar *from, const wchar *stop, TokenList &out) const {
+        out.reserve(static_cast<usize>(stop - from) / 4);
+        Token token;
+        while (next(from, token) && token.offset < offset(stop)) {
+            out.push_back(token);
+        }
+    }
+
+    // append the speculatively lexed `piece` covering [from, stop) to `out`,
+    // relexing its head if the last token in `out` runs past `from`
+    void stitch(TokenList &out, const TokenList &piece, const wchar *from,
+                const wchar *stop) const {
+        if (out.empty() || out.back().end() <= offset(from)) {
+            out.insert(out.end(), piece.begin(), piece.end());
+            return;
+        }
+
+        const wchar *cur = src.begin() + out.back().end();
+        auto spec = piece.begin();
+        Token token;
+
+        while (next(cur, token) && token.offset < offset(stop)) {
+            while (spec != piece.end() && spec->offset < token.offset) {
+                ++spec;
+            }
+            if (spec != piece.end() && *spec == token) {
+                out.insert(out.end(), spec, piece.end());
+                return;
+            }
+            out.push_back(token);
+        }
+    }
+
+    static TokenKind classify(const wchar *start, const wchar *stop,
+                              TokenKind fallback) {
+        return Lexemes.lookup(start, static_cast<usize>(stop - start),
+                              fallback);
+    }
+
+    u32 offset(const wchar *at) const {
+        return static_cast<u32>(at - src.begin());
+    }
+
+    Token make(TokenKind kind, const wchar *start, const wchar *stop,
+               u8 flags = Token::NONE) const {
+        return Token(kind, offset(start), static_cast<u32>(stop - start), file,
+                     flags);
+    }
+
+    // value of `chr` as a digit in `base`, or -1
+    static i32 digit(wchar chr, u32 base) {
+        u32 lower = static_cast<u32>(chr) | 0x20;
+        u32 value = chr >= L'0' && chr <= L'9'      ? chr - L'0'
+                    : lower >= L'a' && lower <= L'f' ? lower - L'a' + 10
+                                                     : base;
+        return value < base ? static_cast<i32>(value) : -1;
+    }
+
+    // a `,` separator must be followed by exactly three digits
+    static bool group_of_three(const wchar *p) {
+        return digit(p[0], 10) >= 0 && digit(p[1], 10) >= 0 &&
+               digit(p[2], 10) >= 0 && digit(p[3], 10) < 0 && p[3] != L'_';
+    }
+
+    // skip decimal digits and `_` separators
+    const wchar *decimals(const wchar *p) const {
+        for (;;) {
+            p = scan->digits(p, src.end());
+            if (*p != L'_' || digit(p[1], 10) < 0) {
+                return p;
+            }
+            ++p;
+        }
+    }
+
+    // decode the number literal at `start`: decimal with an optional fraction
+    // and exponent, `0x` hex or `0b` binary. digits may be split by `_`, and
+    // the integer part of a decimal by `,` in groups of three (`1,286,382`).
+    // integers that fit in 32 bits are kept in the token, anything else goes
+    // to the literal pool. relies on the buffer's NUL terminator as sentinel.
+    const wchar *number(const wchar *start, Token &token) const {
+        const wchar *p = start;
+        u32 base = 10;
+        if (p[0] == L'0' && (p[1] | 0x20) == L'x' && digit(p[2], 16) >= 0) {
+            base = 16;
+            p += 2;
+        } else if (p[0] == L'0' && (p[1] | 0x20) == L'b' &&
+                   digit(p[2], 2) >= 0) {
+            base = 2;
+            p += 2;
+        }
+
+        u64 value = 0;
+        bool overflow = false;
+        usize group = 0;
+        bool grouped = false;
+        for (;;) {
+            if (digit(*p, base) >= 0) {
+                // the scanner finds a decimal run, hex and binary go singly
+                const wchar *run =
+                    base == 10 ? scan->digits(p, src.end()) : p + 1;
+                for (; p < run; ++p, ++group) {
+                    overflow |= __builtin_mul_overflow(value, base, &value);
+                    overflow |= __builtin_add_overflow(
+                        value, static_cast<u64>(digit(*p, base)), &value);
                 }
-                co_yield token;
-                ++column;
-                continue;
+            } else if (*p == L'_' && digit(p[1], base) >= 0) {
+                ++p;
+            } else if (*p == L',' && base == 10 &&
+                       (grouped ? group == 3 : group <= 3) &&
+                       group_of_three(p + 1)) {
+                grouped = true;
+                group = 0;
+                ++p;
+            } else {
+                break;
+            }
+        }
+
+        bool real = false;
+        if (base == 10 && *p == L'.' && digit(p[1], 10) >= 0) {
+            real = true;
+            p = decimals(p + 1);
+        }
+        if (base == 10 && (*p | 0x20) == L'e') {
+            const wchar *exp = p + 1;
+            if (*exp == L'+' || *exp == L'-') {
+                ++exp;
+            }
+            if (digit(*exp, 10) >= 0) {
+                real = true;
+                p = decimals(exp);
             }
-            case L'0' ... L'9': {
-                // number (integer or float)
-                bool is_float = false;
-                while (file.peek() != EOF) {
-                    wchar_t next = file.peek();
-                    if (next >= L'0' && next <= L'9') {
-                        chr = file.get();
-                        token_str += chr;
-                        column++;
-                    } else if (next == L'.' && !is_float) {
-                        chr = file.get();
-                        token_str += chr;
-                        column++;
-                        is_float = true;
-                    } else {
-                        break;
-                    }
+        }
+
+        u8 flags = Token::NONE;
+        NameId id = 0;
+        if (real) {
+            // the literal is plain ascii once separators are dropped
+            char buf[128];
+            usize len = 0;
+            for (const wchar *at = start; at < p; ++at) {
+                if (*at != L'_' && *at != L',' && len < sizeof(buf)) {
+                    buf[len++] = static_cast<char>(*at);
                 }
-                token = Token(TokenKind::NUMBER, token_str, line, column,
-                              token_str.length(), offset, filename);
-                co_yield token;
-                ++column;
+            }
+            f64 real_value = 0;
+            auto [stop, ec] = std::from_chars(buf, buf + len, real_value);
+            if (ec != std::errc() || len == sizeof(buf)) {
+                flags |= Token::MALFORMED;
+            } else {
+                id = src.pool(real_value);
+                flags |= Token::POOLED;
+            }
+        } else if (overflow || (base == 10 && value > INT64_MAX)) {
+            flags |= Token::MALFORMED;
+        } else if (value <= UINT32_MAX) {
+            id = static_cast<NameId>(value);
+        } else {
+            // hex and binary may spell out all 64 bits
+            id = src.pool(static_cast<i64>(value));
+            flags |= Token::POOLED;
+        }
+
+        token = make(TokenKind::NUMBER, start, p, flags);
+        token.id = id;
+        return p;
+    }
+
+    // lex the next token starting at `p`, skipping whitespace and comments.
+    // returns false once the end of the buffer is reached.
+    bool next(const wchar *&p, Token &token) const {
+        const wchar *const end = src.end();
+
+        for (;;) {
+            if (p >= end) {
+                return false;
+            }
+
+            wchar chr = *p;
+
+            if (chr == L'#') {
+                // comment: skip until end of line
+                p = scan->line(p, end);
                 continue;
             }
-            case L'"':
-            case L'\'': {
-                // string literal
-                wchar_t quote = chr;
-                token_str.clear();
-                while (file.peek() != EOF) {
-                    chr = file.get();
-                    if (chr == quote) {
-                        break;
-                    }
-                    if (chr == L'\\') {
-                        // handle escape
-                        wchar_t next = file.get();
-                        switch (next) {
-                        case L'n':
-                            token_str += L'\n';
-                            break;
-                        case L't':
-                            token_str += L'\t';
-                            break;
-                        case L'\\':
-                            token_str += L'\\';
-                            break;
-                        case L'"':
-                            token_str += L'"';
-                            break;
-                        case L'\'':
-                            token_str += L'\'';
-                            break;
-                        default:
-                            token_str += next;
-                            break;
-                        }
-                    } else {
-                        token_str += chr;
-                    }
-                }
-                token = Token(TokenKind::STRING, token_str, line, column,
-                              token_str.length(), offset, filename);
-                co_yield token;
-                ++column;
+
+            if (Scan::scalar::is_space(chr)) {
+                p = scan->space(p + 1, end);
                 continue;
             }
-            case L'#': {
-                // comment: skip until end of line
-                while (file.peek() != EOF) {
-                    chr = file.get();
-                    if (chr == L'\n') {
-                        line++;
-                        column = 0;
-                        break;
-                    }
-                }
+
+            if (chr >= 0x80 && iswspace(chr)) {
+                ++p;
                 continue;
             }
-            default: {
-                // punct or op
-                // try to match multi character operators first
-                bool matched = false;
-                std::wstring punct;
-                punct += chr;
-                wchar_t next = file.peek();
-                if (next != WEOF) {
-                    // try two character operators
-                    punct += next;
-                    usize hash2 = Generation::hash_string(punct);
-                    if (Token::Mapping.contains({hash2})) {
-                        file.get();  // consume next
-                        TokenKind kind = TokenKind::END_OF_FILE;
-                        for (const auto &[key, val] : Token::Mapping) {
-                            if (key.k1 == hash2) {
-                                kind = key.k2;
-                            }
-                        }
-                        token = Token(kind, punct, line, column, punct.length(),
-                                      offset, filename);
-                        co_yield token;
-                        ++column;
-                        matched = true;
-                    }
-                    punct.pop_back();
-                }
-                if (!matched) {
-                    // try single character op or punct
-                    usize hash1 = Generation::hash_string(punct);
-                    if (Token::Mapping.contains({hash1})) {
-                        TokenKind kind = TokenKind::END_OF_FILE;
-                        for (const auto &[key, val] : Token::Mapping) {
-                            if (key.k1 == hash1) {
-                                kind = key.k2;
-                            }
-                        }
-                        token = Token(kind, punct, line, column, punct.length(),
-                                      offset, filename);
-                        co_yield token;
-                        ++column;
-                        matched = true;
-                    }
-                }
-                if (!matched && !iswspace(chr)) {
-                    // unknown/unrecognized character, yield as is or skip
-                    token = Token(TokenKind::END_OF_FILE, std::wstring(1, chr),
-                                  line, column, 1, offset, filename);
-                    co_yield token;
-                    ++column;
+
+            break;
+        }
+
+        const wchar *start = p;
+        wchar chr = *p++;
+
+        switch (chr) {
+        case L'a' ... L'z':
+        case L'A' ... L'Z':
+        case L'_': {
+            // identifier or keyword
+            p = scan->ident(p, end);
+            token = make(classify(start, p, TokenKind::IDENTIFIER), start, p);
+            if (token.kind == TokenKind::IDENTIFIER) {
+                token.id = names->intern(
+                    std::wstring_view(start, static_cast<usize>(p - start)));
+            }
+            return true;
+        }
+        case L'0' ... L'9': {
+            // number (integer or float), decoded right away
+            p = number(start, token);
+            return true;
+        }
+        case L'"':
+        case L'\'': {
+            // string literal, the value is unescaped lazily by the source
+            u8 flags = Token::NONE;
+            for (;;) {
+                p = scan->quote(p, end, chr);
+                if (p >= end || *p == chr) {
+                    break;
                 }
-                continue;
+                flags |= Token::ESCAPED;
+                p = p + 2 < end ? p + 2 : end;
             }
+            if (p < end) {
+                ++p;  // closing quote
+            } else {
+                flags |= Token::UNTERMINATED;
             }
+            token = make(TokenKind::STRING, start, p, flags);
+            return true;
+        }
+        default: {
+            // punct or op, try to match multi character operators first
+            if (p < end) {
+                TokenKind kind = classify(start, p + 1, TokenKind::END_OF_FILE);
+                if (kind != TokenKind::END_OF_FILE) {
+                    token = make(kind, start, ++p);
+                    return true;
+                }
+            }
+
+            // single character op or punct; anything unrecognized is yielded
+            // as is
+            token = make(classify(start, p, TokenKind::END_OF_FILE), start, p);
+            return true;
+        }
         }
-        // yield eof token at the end
-        token = Token(TokenKind::END_OF_FILE, L"", line, column, 0, offset,
-                      filename);
-        co_yield token;
     }
 };
 
 }  // namespace Lexer
 
-#endif  // __lex_h__
\ No newline at end of file
+#endif  // __lex_h__
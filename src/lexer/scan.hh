@@ -0,0 +1,288 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include "types/rints.hh"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_X86 0
+#endif
+
+namespace Lexer {
+namespace Scan {
+    /// \brief Character class scanners over the decoded source buffer.
+    /// \details Every scanner returns a pointer to the first character in
+    ///          `[p, end)` that does not belong to the run (or `end`). On x86
+    ///          the AVX2 (32 bytes) or SSE2 (16 bytes) variant is picked once
+    ///          at startup, everything else uses the scalar loops below. The
+    ///          vector paths assume 32-bit `wchar_t`; 16-bit targets always
+    ///          take the scalar path.
+    struct Scanners {
+        const wchar *(*ident)(const wchar *, const wchar *);
+        const wchar *(*digits)(const wchar *, const wchar *);
+        const wchar *(*space)(const wchar *, const wchar *);
+        const wchar *(*line)(const wchar *, const wchar *);
+        const wchar *(*quote)(const wchar *, const wchar *, wchar);
+    };
+
+    namespace scalar {
+        inline bool is_ident(wchar chr) {
+            return (chr >= L'a' && chr <= L'z') ||
+                   (chr >= L'A' && chr <= L'Z') ||
+                   (chr >= L'0' && chr <= L'9') || chr == L'_';
+        }
+
+        inline bool is_digit(wchar chr) { return chr >= L'0' && chr <= L'9'; }
+
+        inline bool is_space(wchar chr) {
+            return chr == L' ' || (chr >= L'\t' && chr <= L'\r');
+        }
+
+        inline const wchar *ident(const wchar *p, const wchar *end) {
+            while (p < end && is_ident(*p)) {
+                ++p;
+            }
+            return p;
+        }
+
+        inline const wchar *digits(const wchar *p, const wchar *end) {
+            while (p < end && is_digit(*p)) {
+                ++p;
+            }
+            return p;
+        }
+
+        inline const wchar *space(const wchar *p, const wchar *end) {
+            while (p < end && is_space(*p)) {
+                ++p;
+            }
+            return p;
+        }
+
+        inline const wchar *line(const wchar *p, const wchar *end) {
+            while (p < end && *p != L'\n') {
+                ++p;
+            }
+            return p;
+        }
+
+        // stops on the closing quote or an escape
+        inline const wchar *quote(const wchar *p, const wchar *end, wchar q) {
+            while (p < end && *p != q && *p != L'\\') {
+                ++p;
+            }
+            return p;
+        }
+    }  // namespace scalar
+
+#if SCAN_X86
+    namespace sse2 {
+        using vec = __m128i;
+        constexpr usize WIDTH = sizeof(vec) / sizeof(wchar);
+
+        inline vec load(const wchar *p) {
+            return _mm_loadu_si128(reinterpret_cast<const vec *>(p));
+        }
+        inline vec splat(u32 v) { return _mm_set1_epi32(static_cast<i32>(v)); }
+        inline vec in_range(vec v, u32 lo, u32 hi) {
+            return _mm_and_si128(_mm_cmpgt_epi32(v, splat(lo - 1)),
+                                 _mm_cmpgt_epi32(splat(hi + 1), v));
+        }
+        inline u32 mask(vec v) {
+            return static_cast<u32>(_mm_movemask_ps(_mm_castsi128_ps(v)));
+        }
+        constexpr u32 FULL = (1U << WIDTH) - 1;
+
+        // advance while `match(block)` holds for every lane
+        template <typename Match>
+        inline const wchar *run(const wchar *p, const wchar *end,
+                                Match match) {
+            while (end - p >= static_cast<isize>(WIDTH)) {
+                u32 hit = mask(match(load(p)));
+                if (hit != FULL) {
+                    return p + __builtin_ctz(~hit);
+                }
+                p += WIDTH;
+            }
+            return p;
+        }
+
+        // advance until `match(block)` holds for any lane
+        template <typename Match>
+        inline const wchar *find(const wchar *p, const wchar *end,
+                                 Match match) {
+            while (end - p >= static_cast<isize>(WIDTH)) {
+                u32 hit = mask(match(load(p)));
+                if (hit != 0) {
+                    return p + __builtin_ctz(hit);
+                }
+                p += WIDTH;
+            }
+            return p;
+        }
+
+        inline const wchar *ident(const wchar *p, const wchar *end) {
+            p = run(p, end, [](vec v) {
+                vec lower = _mm_or_si128(v, splat(0x20));
+                return _mm_or_si128(
+                    _mm_or_si128(in_range(lower, L'a', L'z'),
+                                 in_range(v, L'0', L'9')),
+                    _mm_cmpeq_epi32(v, splat(L'_')));
+            });
+            return scalar::ident(p, end);
+        }
+
+        inline const wchar *digits(const wchar *p, const wchar *end) {
+            p = run(p, end, [](vec v) { return in_range(v, L'0', L'9'); });
+            return scalar::digits(p, end);
+        }
+
+        inline const wchar *space(const wchar *p, const wchar *end) {
+            p = run(p, end, [](vec v) {
+                return _mm_or_si128(_mm_cmpeq_epi32(v, splat(L' ')),
+                                    in_range(v, L'\t', L'\r'));
+            });
+            return scalar::space(p, end);
+        }
+
+        inline const wchar *line(const wchar *p, const wchar *end) {
+            p = find(p, end,
+                     [](vec v) { return _mm_cmpeq_epi32(v, splat(L'\n')); });
+            return scalar::line(p, end);
+        }
+
+        inline const wchar *quote(const wchar *p, const wchar *end, wchar q) {
+            vec quote = splat(static_cast<u32>(q));
+            p = find(p, end, [quote](vec v) {
+                return _mm_or_si128(_mm_cmpeq_epi32(v, quote),
+                                    _mm_cmpeq_epi32(v, splat(L'\\')));
+            });
+            return scalar::quote(p, end, q);
+        }
+    }  // namespace sse2
+
+#define SCAN_AVX2 __attribute__((target("avx2")))
+    namespace avx2 {
+        using vec = __m256i;
+        constexpr usize WIDTH = sizeof(vec) / sizeof(wchar);
+        constexpr u32 FULL = (1U << WIDTH) - 1;
+
+        SCAN_AVX2 inline vec load(const wchar *p) {
+            return _mm256_loadu_si256(reinterpret_cast<const vec *>(p));
+        }
+        SCAN_AVX2 inline vec splat(u32 v) {
+            return _mm256_set1_epi32(static_cast<i32>(v));
+        }
+        SCAN_AVX2 inline vec eq(vec v, u32 c) {
+            return _mm256_cmpeq_epi32(v, splat(c));
+        }
+        SCAN_AVX2 inline vec in_range(vec v, u32 lo, u32 hi) {
+            return _mm256_and_si256(_mm256_cmpgt_epi32(v, splat(lo - 1)),
+                                    _mm256_cmpgt_epi32(splat(hi + 1), v));
+        }
+        SCAN_AVX2 inline u32 mask(vec v) {
+            return static_cast<u32>(
+                _mm256_movemask_ps(_mm256_castsi256_ps(v)));
+        }
+
+        // number of leading lanes for which the block matched
+        SCAN_AVX2 inline const wchar *stop(const wchar *p, u32 hit) {
+            return p + __builtin_ctz(~hit);
+        }
+
+        SCAN_AVX2 inline const wchar *ident(const wchar *p,
+                                            const wchar *end) {
+            for (; end - p >= static_cast<isize>(WIDTH); p += WIDTH) {
+                vec v = load(p);
+                vec lower = _mm256_or_si256(v, splat(0x20));
+                u32 hit = mask(_mm256_or_si256(
+                    _mm256_or_si256(in_range(lower, L'a', L'z'),
+                                    in_range(v, L'0', L'9')),
+                    eq(v, L'_')));
+                if (hit != FULL) {
+                    return stop(p, hit);
+                }
+            }
+            return sse2::ident(p, end);
+        }
+
+        SCAN_AVX2 inline const wchar *digits(const wchar *p,
+                                             const wchar *end) {
+            for (; end - p >= static_cast<isize>(WIDTH); p += WIDTH) {
+                u32 hit = mask(in_range(load(p), L'0', L'9'));
+                if (hit != FULL) {
+                    return stop(p, hit);
+                }
+            }
+            return sse2::digits(p, end);
+        }
+
+        SCAN_AVX2 inline const wchar *space(const wchar *p,
+                                            const wchar *end) {
+            for (; end - p >= static_cast<isize>(WIDTH); p += WIDTH) {
+                vec v = load(p);
+                u32 hit = mask(_mm256_or_si256(eq(v, L' '),
+                                               in_range(v, L'\t', L'\r')));
+                if (hit != FULL) {
+                    return stop(p, hit);
+                }
+            }
+            return sse2::space(p, end);
+        }
+
+        SCAN_AVX2 inline const wchar *line(const wchar *p, const wchar *end) {
+            for (; end - p >= static_cast<isize>(WIDTH); p += WIDTH) {
+                u32 hit = mask(eq(load(p), L'\n'));
+                if (hit != 0) {
+                    return p + __builtin_ctz(hit);
+                }
+            }
+            return sse2::line(p, end);
+        }
+
+        SCAN_AVX2 inline const wchar *quote(const wchar *p, const wchar *end,
+                                            wchar q) {
+            for (; end - p >= static_cast<isize>(WIDTH); p += WIDTH) {
+                vec v = load(p);
+                u32 hit = mask(
+                    _mm256_or_si256(eq(v, static_cast<u32>(q)), eq(v, L'\\')));
+                if (hit != 0) {
+                    return p + __builtin_ctz(hit);
+                }
+            }
+            return sse2::quote(p, end, q);
+        }
+    }  // namespace avx2
+#undef SCAN_AVX2
+#endif
+
+    inline Scanners select() {
+#if SCAN_X86
+        if constexpr (sizeof(wchar) == 4) {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return {avx2::ident, avx2::digits, avx2::space, avx2::line,
+                        avx2::quote};
+            }
+            return {sse2::ident, sse2::digits, sse2::space, sse2::line,
+                    sse2::quote};
+        }
+#endif
+        return {scalar::ident, scalar::digits, scalar::space, scalar::line,
+                scalar::quote};
+    }
+
+    /// The scanners picked for this cpu, resolved on first use.
+    inline const Scanners &scanners() {
+        static const Scanners chosen = select();
+        return chosen;
+    }
+}  // namespace Scan
+}  // namespace Lexer
+
+#undef SCAN_X86
+
+#endif  // __SCAN_H__
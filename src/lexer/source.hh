@@ -0,0 +1,341 @@
+#ifndef __SOURCE_H__
+#define __SOURCE_H__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "lexer/scan.hh"
+#include "lexer/tokens.hh"
+#include "types/literal.hh"
+#include "types/rints.hh"
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Lexer {
+
+/// A zero based line and column inside a source buffer.
+struct Location {
+    usize line;
+    usize column;
+};
+
+/// \brief A decoded, contiguous view of a source file.
+/// \details The file is memory-mapped when it is a regular file and read in
+///          large blocks otherwise (pipes, character devices, `/dev/stdin`).
+///          The raw UTF-8 bytes are decoded in one pass into a wide buffer
+///          that is always NUL terminated, so the lexer can walk it with raw
+///          pointers and use the terminator as a sentinel. Numeric literals
+///          too large to live in their token are kept in a pool that
+///          survives reloads, so tokens lexed before a reload stay valid.
+class Source {
+  public:
+    Source() = default;
+
+    explicit Source(string filename)
+        : filename(std::move(filename)) {
+        load();
+    }
+
+    Source(const Source &) = default;
+    Source(Source &&) = default;
+    Source &operator=(const Source &) = default;
+    Source &operator=(Source &&) = default;
+
+    /// Build a source from an in-memory UTF-8 buffer.
+    static Source from_utf8(std::string_view bytes, string name = L"") {
+        Source src;
+        src.filename = std::move(name);
+        src.assign(bytes);
+        return src;
+    }
+
+    /// Replace the contents with an in-memory UTF-8 buffer.
+    void assign(std::string_view bytes) {
+        lines.clear();
+        decode(bytes);
+        valid = true;
+    }
+
+    /// Re-read the file from disk, replacing the decoded buffer.
+    bool load() {
+        valid = false;
+        buffer.clear();
+        lines.clear();
+
+        std::string path = std::filesystem::path(filename).string();
+        if (!map_file(path) && !read_file(path)) {
+            return false;
+        }
+
+        valid = true;
+        return true;
+    }
+
+    bool ok() const { return valid; }
+    const string &name() const { return filename; }
+
+    const wchar *begin() const { return buffer.data(); }
+    const wchar *end() const { return buffer.data() + buffer.size(); }
+    usize size() const { return buffer.size(); }
+
+    std::wstring_view view() const { return buffer; }
+    std::wstring_view slice(usize offset, usize length) const {
+        return std::wstring_view(buffer).substr(offset, length);
+    }
+
+    /// The raw text of a token, quotes and escapes included.
+    std::wstring_view text(const Token &token) const {
+        return slice(token.offset, token.length);
+    }
+
+    /// The value of a token: the unescaped contents of a string literal,
+    /// the raw text of anything else.
+    string value(const Token &token) const {
+        string out;
+        append_value(token, out);
+        return out;
+    }
+
+    /// Append the value of a token to `out`, see `value`.
+    void append_value(const Token &token, string &out) const {
+        std::wstring_view raw = text(token);
+        if (token.kind != TokenKind::STRING || raw.empty()) {
+            out += raw;
+            return;
+        }
+
+        raw.remove_prefix(1);
+        if (!(token.flags & Token::UNTERMINATED) && !raw.empty()) {
+            raw.remove_suffix(1);
+        }
+        if (!(token.flags & Token::ESCAPED)) {
+            out += raw;
+            return;
+        }
+
+        out.reserve(out.size() + raw.size());
+        for (usize i = 0; i < raw.size(); ++i) {
+            if (raw[i] != L'\\' || i + 1 == raw.size()) {
+                out += raw[i];
+                continue;
+            }
+            switch (raw[++i]) {
+            case L'n':
+                out += L'\n';
+                break;
+            case L't':
+                out += L'\t';
+                break;
+            default:
+                out += raw[i];
+                break;
+            }
+        }
+    }
+
+    /// The decoded value of a `NUMBER` token.
+    Literal literal(const Token &token) const {
+        if (token.flags & Token::POOLED) {
+            return (*literals)[token.id];
+        }
+        return static_cast<i64>(token.id);
+    }
+
+    /// Store a literal that does not fit in a token, returning its index.
+    u32 pool(Literal value) const { return literals->add(value); }
+
+    /// Line and column of a buffer offset. The line start index is built on
+    /// first use, so call `index_lines()` up front before sharing the source
+    /// between threads.
+    Location location(usize offset) const {
+        index_lines();
+        auto it = std::upper_bound(lines.begin(), lines.end(),
+                                   static_cast<u32>(offset));
+        usize line = static_cast<usize>(it - lines.begin()) - 1;
+        return {line, offset - lines[line]};
+    }
+
+    Location location(const Token &token) const {
+        return location(token.offset);
+    }
+
+    void index_lines() const {
+        if (!lines.empty()) {
+            return;
+        }
+
+        const Scan::Scanners &scan = Scan::scanners();
+        lines.push_back(0);
+        for (const wchar *p = scan.line(begin(), end()); p < end();
+             p = scan.line(p, end())) {
+            ++p;
+            lines.push_back(static_cast<u32>(p - begin()));
+        }
+    }
+
+  private:
+    string filename;
+    string buffer;
+    bool valid = false;
+    mutable std::vector<u32> lines;
+    std::shared_ptr<Literals> literals = std::make_shared<Literals>();
+
+    bool map_file(const std::string &path) {
+#if defined(_WIN32)
+        (void)path;
+        return false;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st {};
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            return false;
+        }
+
+        if (st.st_size == 0) {
+            ::close(fd);
+            return true;
+        }
+
+        usize len = static_cast<usize>(st.st_size);
+        void *data = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (data == MAP_FAILED) {
+            return false;
+        }
+
+        ::madvise(data, len, MADV_SEQUENTIAL);
+        decode(std::string_view(static_cast<const char *>(data), len));
+        ::munmap(data, len);
+        return true;
+#endif
+    }
+
+    bool read_file(const std::string &path) {
+        std::string bytes;
+        char block[1 << 16];
+
+#if defined(_WIN32)
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) {
+            return false;
+        }
+        while (in.read(block, sizeof(block)) || in.gcount() > 0) {
+            bytes.append(block, static_cast<usize>(in.gcount()));
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        for (;;) {
+            ssize_t n = ::read(fd, block, sizeof(block));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            bytes.append(block, static_cast<usize>(n));
+        }
+        ::close(fd);
+#endif
+
+        decode(bytes);
+        return true;
+    }
+
+    // decode utf-8 into the wide buffer. ascii runs are widened 8 bytes at a
+    // time, anything malformed becomes U+FFFD.
+    void decode(std::string_view bytes) {
+        buffer.resize(bytes.size());
+
+        const auto *in = reinterpret_cast<const u8 *>(bytes.data());
+        const u8 *const stop = in + bytes.size();
+        wchar *out = buffer.data();
+
+        while (in < stop) {
+            while (stop - in >= 8) {
+                u64 block;
+                std::memcpy(&block, in, sizeof(block));
+                if (block & 0x8080808080808080ULL) {
+                    break;
+                }
+                for (usize i = 0; i < 8; ++i) {
+                    out[i] = static_cast<wchar>(in[i]);
+                }
+                in += 8;
+                out += 8;
+            }
+
+            if (in >= stop) {
+                break;
+            }
+
+            u32 lead = *in;
+            if (lead < 0x80) {
+                *out++ = static_cast<wchar>(lead);
+                ++in;
+                continue;
+            }
+
+            usize need = lead >= 0xF8   ? 0
+                         : lead >= 0xF0 ? 3
+                         : lead >= 0xE0 ? 2
+                         : lead >= 0xC0 ? 1
+                                        : 0;
+            u32 cp = lead & (0x3F >> need);
+            bool good = need != 0 && static_cast<usize>(stop - in) > need;
+
+            for (usize i = 1; good && i <= need; ++i) {
+                if ((in[i] & 0xC0) != 0x80) {
+                    good = false;
+                } else {
+                    cp = (cp << 6) | (in[i] & 0x3F);
+                }
+            }
+
+            if (!good || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+                *out++ = static_cast<wchar>(0xFFFD);
+                ++in;
+                continue;
+            }
+
+            in += need + 1;
+            if constexpr (sizeof(wchar) == 2) {
+                if (cp >= 0x10000) {
+                    cp -= 0x10000;
+                    *out++ = static_cast<wchar>(0xD800 + (cp >> 10));
+                    *out++ = static_cast<wchar>(0xDC00 + (cp & 0x3FF));
+                    continue;
+                }
+            }
+            *out++ = static_cast<wchar>(cp);
+        }
+
+        buffer.resize(static_cast<usize>(out - buffer.data()));
+    }
+};
+
+}  // namespace Lexer
+
+#endif  // __SOURCE_H__
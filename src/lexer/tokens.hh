@@ -1,166 +1,96 @@
 #ifndef __TOKENS_H__
 #define __TOKENS_H__
 
-#include <map>
-#include <tuple>
-#include <unordered_map>
-#include <utility>
-
 #include "lexer/generation.hh"
 #include "lexer/lexemes.hh"
+#include "types/intern.hh"
 
 namespace Lexer {
 MAKE_ENUM(TokenKind : u8, TOKENS(ENUM_GEN));
 
-struct KeyT {
-    u64 k1;
-    TokenKind k2;
-
-    constexpr KeyT(u64 k1, TokenKind k2)
-        : k1(k1)
-        , k2(std::move(k2)) {}
-    constexpr KeyT()
-        : k1(0)
-        , k2(TokenKind::END_OF_FILE) {}
-    constexpr KeyT(const u64 k1)
-        : k1(k1)
-        , k2(TokenKind::END_OF_FILE) {}
-    constexpr KeyT(TokenKind k2)
-        : k1(0)
-        , k2(std::move(k2)) {}
-
-    constexpr KeyT(const KeyT &other) = default;
-    constexpr KeyT(KeyT &&other) = default;
-    constexpr KeyT &operator=(const KeyT &other) = default;
-    constexpr KeyT &operator=(KeyT &&other) = default;
-    constexpr ~KeyT() = default;
-
-    constexpr bool operator==(const u64 &other) const { return k1 == other; }
-
-    constexpr bool operator==(const TokenKind &other) const {
-        return k2 == other;
-    }
-
-    constexpr bool operator==(const KeyT &other) const {
-        return k1 == other.k1 || k2 == other.k2;
-    }
-
-    constexpr bool operator!=(const KeyT &other) const {
-        return !(*this == other);
-    }
-};
-
-struct KeyHash {
-    using is_transparent = void;
-
-    size_t operator()(const KeyT &k) const {
-        return std::hash<u64>()(k.k1) ^
-               std::hash<int>()(static_cast<int>(k.k2));
-    }
-    size_t operator()(u64 k1) const { return std::hash<u64>()(k1); }
-    size_t operator()(TokenKind k2) const {
-        return std::hash<int>()(static_cast<int>(k2));
-    }
-};
-
-struct KeyEqual {
-    using is_transparent = void;
-
-    bool operator()(const KeyT &lhs, const KeyT &rhs) const {
-        return lhs == rhs;
-    }
-    bool operator()(const KeyT &lhs, u64 rhs) const { return lhs.k1 == rhs; }
-    bool operator()(const KeyT &lhs, TokenKind rhs) const {
-        return lhs.k2 == rhs;
-    }
-};
-}  // namespace Lexer
-
-namespace std {
-template <>
-struct hash<Lexer::KeyT> {
-    size_t operator()(const Lexer::KeyT &key) const {
-        return hash<u64>()(key.k1) ^ (hash<Lexer::TokenKind>()(key.k2) << 1);
-    }
-};
-}  // namespace std
-
-namespace Lexer {
-
+// keyword, operator and punctuator classification, generated from the same
+// table as the enum so the two can never drift apart
+MAKE_LEXEMES(Lexemes, TOKENS(LEXEME_GEN));
+static_assert(Lexemes.lookup(L"**", 2, TokenKind::END_OF_FILE) == TokenKind::POW);
+static_assert(Lexemes.lookup(L"fn", 2, TokenKind::IDENTIFIER) ==
+              TokenKind::IDENTIFIER);
+
+/// \brief A lexeme as a slice of its source buffer.
+/// \details Tokens never own text. `offset` and `length` index the decoded
+///          buffer of the source identified by `file`; the text, unescaped
+///          string value and line/column are all recovered on demand through
+///          `Source`. Identifiers also carry their interned `id`, so later
+///          stages never look at their text. Offsets are 32-bit, so a single
+///          source is limited to 4G characters.
 class Token {
   public:
-    using TokenMap = std::unordered_map<KeyT, string>;
-
-    MAKE_MAP(Mapping, TOKENS(MAP_GEN));
+    enum Flags : u8 {
+        NONE = 0,
+        ESCAPED = 1 << 0,       // string literal contains escape sequences
+        UNTERMINATED = 1 << 1,  // string literal ran into end of file
+        POOLED = 1 << 2,        // number value is in the literal pool
+        MALFORMED = 1 << 3,     // number literal is out of range
+    };
 
   public:
+    // for numbers `id` holds the value itself, or its index in the source's
+    // literal pool when `POOLED` is set
+    u32 offset;
+    u32 length;
+    u16 file;
     TokenKind kind;
-    string value;
-    usize line;
-    usize column;
-    usize length;
-    usize offset;
-    string filename;
+    u8 flags;
+    NameId id;
 
   public:
-    Token(TokenKind kind, string value, usize line, usize column, usize length,
-          usize offset, string filename)
-        : kind(kind)
-        , value(std::move(value))
-        , line(line)
-        , column(column)
+    constexpr Token(TokenKind kind, u32 offset, u32 length, u16 file = 0,
+                    u8 flags = NONE, NameId id = Interner::NONE)
+        : offset(offset)
         , length(length)
-        , offset(offset)
-        , filename(std::move(filename)) {}
-    Token(TokenKind kind, string value, string filename = L"")
-        : kind(kind)
-        , value(std::move(value))
-        , line(0)
-        , column(0)
-        , length(0)
-        , offset(0)
-        , filename(std::move(filename)) {}
-    Token(TokenKind kind)
-        : kind(kind)
-        , line(0)
-        , column(0)
-        , length(0)
-        , offset(0) {}
-    Token()
-        : kind(TokenKind::END_OF_FILE)
-        , line(0)
-        , column(0)
-        , length(0)
-        , offset(0) {}
-
-    Token(const Token &other) = default;
-    Token(Token &&other) = default;
-    Token &operator=(const Token &other) = default;
-    Token &operator=(Token &&other) = default;
-    Token &operator=(TokenKind kind) {
+        , file(file)
+        , kind(kind)
+        , flags(flags)
+        , id(id) {}
+    constexpr Token(TokenKind kind)
+        : Token(kind, 0, 0) {}
+    constexpr Token()
+        : Token(TokenKind::END_OF_FILE) {}
+
+    constexpr Token(const Token &other) = default;
+    constexpr Token(Token &&other) = default;
+    constexpr Token &operator=(const Token &other) = default;
+    constexpr Token &operator=(Token &&other) = default;
+    constexpr Token &operator=(TokenKind kind) {
         this->kind = kind;
-        this->value = Mapping.at(kind);
         return *this;
     }
 
-    ~Token() = default;
+    constexpr ~Token() = default;
+
+    constexpr u32 end() const { return offset + length; }
 
-    bool operator==(const Token &other) const {
-        return kind == other.kind && value == other.value &&
-               line == other.line && column == other.column &&
-               length == other.length && offset == other.offset &&
-               filename == other.filename;
+    constexpr bool operator==(const Token &other) const {
+        return kind == other.kind && offset == other.offset &&
+               length == other.length && file == other.file &&
+               flags == other.flags && id == other.id;
     }
 
-    bool operator!=(const Token &other) const { return !(*this == other); }
-    bool operator==(TokenKind kind) const { return this->kind == kind; }
-    bool operator!=(TokenKind kind) const { return !(*this == kind); }
+    constexpr bool operator!=(const Token &other) const {
+        return !(*this == other);
+    }
+    constexpr bool operator==(TokenKind kind) const {
+        return this->kind == kind;
+    }
+    constexpr bool operator!=(TokenKind kind) const { return !(*this == kind); }
 };
+
+// offset, length, file, kind, flags and id, with no padding
+static_assert(sizeof(Token) == 16, "Token must stay compact");
 }  // namespace Lexer
 
 #undef ENUM_GEN
 #undef MAKE_ENUM
-#undef MAP_GEN
-#undef MAKE_MAP
+#undef LEXEME_GEN
+#undef MAKE_LEXEMES
 
 #endif  // __TOKENS_H__
\ No newline at end of file
@@ -1,97 +1,252 @@
 #include <codecvt>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <latch>
 #include <locale>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include "ast/ast.hh"
 #include "ast/parser.hh"
+#include "ast/token_stream.hh"
+#include "driver/cache.hh"
+#include "driver/driver.hh"
 #include "lexer/lexer.hh"
 #include "lexer/tokens.hh"
+#include "sema/infer.hh"
+#include "sema/resolve.hh"
 #include "thread/worker.hh"
+#include "types/intern.hh"
 #include "vm/codegen.hh"
+#include "vm/optimize.hh"
+#include "vm/serialize.hh"
 #include "vm/vm.hh"
 
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        std::wcerr << L"Usage: " << argv[0] << L" <source-file>\n";
+static int usage(const char *self) {
+    std::wcerr << L"Usage: " << self << L" [options] <source-file>\n"
+               << L"       " << self << L" <bytecode.csb>\n"
+               << L"       " << self
+               << L" -c [-o <dir>] [-j <threads>] [options] <file|dir>...\n"
+               << L"Options: -O<0-2>, --lazy, --no-cache, --cache-dir <dir>\n"
+               << L"The cache defaults to $C_SET_CACHE or ~/.cache/c-set.\n";
+    return 1;
+}
+
+static void dump(const Bytecode &bytecode) {
+    std::wcout << L"Bytecode generated (" << bytecode.size()
+               << L" instructions):\n";
+    for (size_t i = 0; i < bytecode.size(); ++i) {
+        const auto &instr = bytecode[i];
+        std::wcout << i << L": " << static_cast<int>(instr.op);
+        switch (instr.op) {
+        case OpCode::PUSH_INT:
+            std::wcout << L" " << static_cast<int32_t>(instr.operand);
+            break;
+        case OpCode::PUSH_INT_CONST:
+            std::wcout << L" " << bytecode.ints[instr.operand];
+            break;
+        case OpCode::PUSH_FLOAT:
+            std::wcout << L" " << bytecode.floats[instr.operand];
+            break;
+        case OpCode::PUSH_STR:
+            std::wcout << L" \"" << bytecode.strings[instr.operand] << L"\"";
+            break;
+        case OpCode::LOAD:
+        case OpCode::STORE:
+        case OpCode::LOAD_LOCAL:
+        case OpCode::STORE_LOCAL:
+            std::wcout << L" " << instr.operand;
+            break;
+        case OpCode::JMP:
+        case OpCode::JMP_IF_FALSE:
+        case OpCode::JMP_IF_TRUE:
+        case OpCode::CALL:
+            std::wcout << L" @" << instr.operand;
+            break;
+        default:
+            break;
+        }
+        std::wcout << std::endl;
+    }
+}
+
+static int execute(Bytecode bytecode, size_t globals) {
+    std::wcout << L"\n--- VM Execution ---" << std::endl;
+    VM vm;
+    vm.load(std::move(bytecode), globals);
+    try {
+        vm.run();
+    } catch (const std::exception &ex) {
+        std::wcerr << L"Runtime error: " << ex.what() << std::endl;
         return 1;
     }
 
+    std::wcout << L"Execution finished successfully.\n";
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    // -c: compile every input to a .csb file instead of running it
+    // --lazy: parse function bodies on their first call only
+    // --no-cache, --cache-dir: where compiled bytecode is reused from
+    // -O<level>: the peephole level, see optimize(); -O alone is -O2
+    bool compile = false;
+    bool use_cache = true;
+    CompileOptions options;
+    std::vector<std::filesystem::path> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "-c") {
+            compile = true;
+        } else if (arg == "--lazy") {
+            options.lazy = true;
+        } else if (arg == "--no-cache") {
+            use_cache = false;
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            options.cache_dir = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            options.out_dir = argv[++i];
+        } else if (arg == "-j" && i + 1 < argc) {
+            options.jobs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg.starts_with("-O")) {
+            options.opt_level =
+                arg.size() == 2 ? 2 : std::strtoul(&arg[2], nullptr, 10);
+        } else {
+            paths.emplace_back(arg);
+        }
+    }
+
     std::locale::global(std::locale("en_US.UTF-8"));
 
+    if (!use_cache)
+        options.cache_dir.clear();
+    else if (options.cache_dir.empty())
+        options.cache_dir = BytecodeCache::default_dir();
+
+    if (compile) {
+        if (paths.empty())
+            return usage(argv[0]);
+        return compile_all(paths, options) == 0 ? 0 : 1;
+    }
+    if (paths.size() != 1)
+        return usage(argv[0]);
+    if (paths[0].extension() == ".csb") {
+        std::ifstream in(paths[0], std::ios::binary);
+        Bytecode bytecode;
+        size_t globals = 0;
+        if (!read_bytecode(in, bytecode, globals)) {
+            std::wcerr << L"Not a bytecode file of this version: "
+                       << paths[0].wstring() << std::endl;
+            return 1;
+        }
+        return execute(std::move(bytecode), globals);
+    }
+
     std::wstring filename =
-        std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(argv[1]);
+        std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(
+            paths[0].string());
     std::wcout << L"Reading source file: " << filename << std::endl;
 
-    // lexing
-    std::wcout << L"--- Lexing ---" << std::endl;
     using ThreadManager = WorkerThread;
     ThreadManager worker;
-    Lexer::Lexer<ThreadManager> lexer(filename, &worker);
+    Interner names;
+    Lexer::Lexer<ThreadManager> lexer(filename, &worker, &names);
 
-    std::vector<Lexer::Token> tokens;
-    for (auto t : lexer.tokenize()) {
-        tokens.push_back(t);
-        std::wcout << L"Token: " << t.value << L" (" << static_cast<int>(t.kind)
-                   << L")\n";
+    // the key hashes the text the lexer is about to read
+    std::optional<BytecodeCache> cache;
+    std::optional<BytecodeCache::Key> key;
+    if (!options.cache_dir.empty() && lexer.open()) {
+        cache.emplace(options.cache_dir, codegen_flags(options));
+        key = cache->key(paths[0], lexer.source().view());
+    }
+    if (key) {
+        Bytecode bytecode;
+        size_t globals = 0;
+        if (cache->load(*key, bytecode, globals)) {
+            std::wcout << L"Loaded bytecode from the cache." << std::endl;
+            dump(bytecode);
+            return execute(std::move(bytecode), globals);
+        }
     }
 
-    if (tokens.empty()) {
+    // lexing and parsing, overlapped: the worker lexes into a bounded
+    // channel while this thread parses what has arrived so far
+    std::wcout << L"--- Lexing + Parsing ---" << std::endl;
+
+    TokenChannel channel;
+    std::latch lexed(1);
+    worker.async([&] {
+        for (auto batch : lexer.tokenize_batched()) {
+            if (!channel.push(batch)) {
+                break;
+            }
+        }
+        channel.close();
+        lexed.count_down();
+    });
+
+    ParserContext ctx(names);
+    ctx.lazy_bodies = options.lazy;
+    Parser parser(TokenStream(channel), lexer.source(), ctx);
+    parser.parse_program();
+    channel.close();
+    lexed.wait();
+
+    if (parser.stream().received() == 0) {
         std::wcerr << L"No tokens produced. Exiting.\n";
         return 1;
     }
+    std::wcout << L"Lexed " << parser.stream().received() << L" tokens.\n";
 
-    // parsing
-    std::wcout << L"\n--- Parsing ---" << std::endl;
-    ParserContext ctx;
-    Parser parser(tokens, ctx);
-    ASTNodePtr ast = parser.parse_program();
-
-    if (!ast) {
-        std::wcerr << L"Parsing failed. Exiting.\n";
+    if (ctx.sema.has_errors()) {
+        ctx.sema.print_errors();
         return 1;
     }
-    std::wcout << L"AST successfully built.\n";
+    std::wcout << L"AST successfully built (" << ctx.ast.size()
+               << L" nodes).\n";
 
     // code generation
     std::wcout << L"\n--- Code Generation ---" << std::endl;
-    CodeGen codegen;
+    Resolver resolver(ctx.ast);
+    TypeInference types(ctx.ast);
+    CodeGen codegen(names);
+    codegen.expand = [&](NodeId func) {
+        NodeId body = parser.parse_body(func);
+        resolver.resolve_function(func);
+        types.infer_function(func);
+        return body;
+    };
     Bytecode bytecode;
     try {
-        bytecode = codegen.generate(ast);
+        resolver.resolve();
+        types.infer();
+        bytecode = codegen.generate(ctx.ast);
     } catch (const std::exception &ex) {
         std::wcerr << L"Code generation error: " << ex.what() << std::endl;
         return 1;
     }
-    std::wcout << L"Bytecode generated (" << bytecode.size()
-               << L" instructions):\n";
-    for (size_t i = 0; i < bytecode.size(); ++i) {
-        const auto &instr = bytecode[i];
-        std::wcout << i << L": " << static_cast<int>(instr.op);
-        if (std::holds_alternative<int64_t>(instr.operand)) {
-            std::wcout << L" " << std::get<int64_t>(instr.operand);
-        } else if (std::holds_alternative<std::wstring>(instr.operand)) {
-            std::wcout << L" \"" << std::get<std::wstring>(instr.operand)
-                       << L"\"";
-        } else if (std::holds_alternative<size_t>(instr.operand)) {
-            std::wcout << L" @" << std::get<size_t>(instr.operand);
-        }
-        std::wcout << std::endl;
-    }
-
-    // vm execution
-    std::wcout << L"\n--- VM Execution ---" << std::endl;
-    VM vm;
-    vm.load(bytecode, codegen.ctx.globals.size());
-    try {
-        vm.run();
-    } catch (const std::exception &ex) {
-        std::wcerr << L"Runtime error: " << ex.what() << std::endl;
+    // bodies parsed on demand report their errors only now
+    if (ctx.sema.has_errors()) {
+        ctx.sema.print_errors();
         return 1;
     }
+    if (options.opt_level > 0) {
+        size_t before = bytecode.size();
+        optimize(bytecode, options.opt_level);
+        std::wcout << L"Optimized at -O" << options.opt_level << L": "
+                   << before << L" -> " << bytecode.size()
+                   << L" instructions." << std::endl;
+    }
+    size_t globals = codegen.globals;
+    if (key)
+        cache->store(*key, imports_of(ctx.ast, names, paths[0]), bytecode,
+                     globals);
+    dump(bytecode);
 
-    std::wcout << L"Execution finished successfully.\n";
-    return 0;
+    return execute(std::move(bytecode), globals);
 }
\ No newline at end of file
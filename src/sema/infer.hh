@@ -0,0 +1,242 @@
+#ifndef __INFER_HH__
+#define __INFER_HH__
+
+#include <optional>
+#include <vector>
+
+#include "ast/ast.hh"
+#include "types/value_type.hh"
+
+/// \brief Infers the static type of every expression in a resolved `Ast`.
+/// \details Each variable slot gets one type for the whole program, the
+///          join of everything ever stored in it: a declaration without an
+///          initializer stores the integer zero the VM starts slots with,
+///          parameters and call results are `Unknown`. Variable types
+///          depend on expressions that read variables, so the program and
+///          every parsed function body are walked until no slot changes.
+///          A global read from a function may run before the global is
+///          initialized, so such a read also allows an integer. While some
+///          bodies are still `Deferred`, code nobody has seen may store
+///          anything in a global, so globals are all `Unknown`.
+class TypeInference {
+    Ast &ast;
+    std::vector<std::optional<ValueType>> globals;  // by slot, unset if
+    std::vector<std::optional<ValueType>> locals;   // never stored to
+    std::vector<NodeId> functions;  // parsed bodies, see `collect`
+    bool in_function = false;
+    bool open = false;  // a body is still unparsed
+    bool changed = false;  // a global, every frame has to be walked again
+    bool locals_changed = false;
+
+  public:
+    explicit TypeInference(Ast &ast)
+        : ast(ast) {}
+
+    /// Type the program and every function body parsed so far.
+    void infer() {
+        if (ast.root == Ast::NONE)
+            return;
+        globals.assign(ast[ast.root].b, std::nullopt);
+        collect(ast.root);
+        do {
+            changed = false;
+            frame(ast.root);
+            for (NodeId decl : functions)
+                frame(decl);
+        } while (changed);
+    }
+
+    /// Type a function whose body was parsed after `infer`, see
+    /// `Parser::parse_body`.
+    void infer_function(NodeId decl) {
+        open = true;
+        usize first = functions.size();
+        functions.push_back(decl);
+        collect(ast[decl].c);
+        for (usize i = first; i < functions.size(); ++i)
+            frame(functions[i]);
+    }
+
+  private:
+    static ValueType join(ValueType a, ValueType b) {
+        return a == b ? a : ValueType::Unknown;
+    }
+
+    // the function declarations below `id` whose bodies were parsed
+    void collect(NodeId id) {
+        if (id == Ast::NONE)
+            return;
+        const Node &node = ast[id];
+        switch (node.kind) {
+        case ASTNodeKind::Program:
+        case ASTNodeKind::Block:
+            for (NodeId stmt : ast.list(node.a))
+                collect(stmt);
+            break;
+        case ASTNodeKind::FuncDecl:
+            if (node.c == Ast::NONE ||
+                ast[node.c].kind == ASTNodeKind::Deferred) {
+                open = true;
+                break;
+            }
+            functions.push_back(id);
+            collect(node.c);
+            break;
+        case ASTNodeKind::If:
+            collect(node.b);
+            collect(node.c);
+            break;
+        case ASTNodeKind::While:
+            collect(node.b);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // walk one frame, the program or a function, until its locals settle
+    void frame(NodeId id) {
+        const Node &node = ast[id];
+        in_function = node.kind == ASTNodeKind::FuncDecl;
+        locals.clear();
+        if (in_function) {
+            for (usize slot = 0; slot < ast.list(node.b).size(); ++slot)
+                store(Storage::Local, static_cast<u32>(slot),
+                      ValueType::Unknown);
+        }
+        do {
+            locals_changed = false;
+            visit(in_function ? node.c : id);
+        } while (locals_changed);
+    }
+
+    std::optional<ValueType> &slot(Storage storage, u32 index) {
+        auto &slots = storage == Storage::Global ? globals : locals;
+        if (index >= slots.size())
+            slots.resize(index + 1);
+        return slots[index];
+    }
+
+    void store(Storage storage, u32 index, ValueType type) {
+        if (storage == Storage::Unresolved)
+            return;
+        std::optional<ValueType> &current = slot(storage, index);
+        ValueType joined = current ? join(*current, type) : type;
+        if (current == joined)
+            return;
+        current = joined;
+        (storage == Storage::Global ? changed : locals_changed) = true;
+    }
+
+    ValueType load(Storage storage, u32 index) {
+        if (storage == Storage::Unresolved ||
+            (storage == Storage::Global && open))
+            return ValueType::Unknown;
+        std::optional<ValueType> type = slot(storage, index);
+        if (!type)
+            return ValueType::Unknown;
+        if (storage == Storage::Global && in_function)
+            return join(*type, ValueType::Int);
+        return *type;
+    }
+
+    ValueType visit(NodeId id) {
+        if (id == Ast::NONE)
+            return ValueType::Unknown;
+        Node &node = ast[id];
+        ValueType type = ValueType::Unknown;
+        switch (node.kind) {
+        case ASTNodeKind::Program:
+        case ASTNodeKind::Block:
+            for (NodeId stmt : ast.list(node.a))
+                visit(stmt);
+            break;
+        case ASTNodeKind::VarDecl:
+            store(node.storage, node.c,
+                  node.b == Ast::NONE ? ValueType::Int : visit(node.b));
+            break;
+        case ASTNodeKind::Assign:
+            type = visit(node.b);
+            store(node.storage, node.c, type);
+            break;
+        case ASTNodeKind::Identifier:
+            type = load(node.storage, node.c);
+            break;
+        case ASTNodeKind::Number:
+            type = std::holds_alternative<i64>(ast.number(node))
+                       ? ValueType::Int
+                       : ValueType::Float;
+            break;
+        case ASTNodeKind::String:
+            type = ValueType::String;
+            break;
+        case ASTNodeKind::Binary:
+            type = binary(node.op, visit(node.a), visit(node.b));
+            break;
+        case ASTNodeKind::Unary: {
+            ValueType operand = visit(node.a);
+            if (node.op == Lexer::TokenKind::NOT)
+                type = ValueType::Bool;
+            else if (operand == ValueType::Int || operand == ValueType::Float)
+                type = operand;
+            break;
+        }
+        case ASTNodeKind::Call:
+            for (NodeId arg : ast.list(node.b))
+                visit(arg);
+            break;
+        case ASTNodeKind::If:
+            visit(node.a);
+            visit(node.b);
+            visit(node.c);
+            break;
+        case ASTNodeKind::While:
+            visit(node.a);
+            visit(node.b);
+            break;
+        case ASTNodeKind::Return:
+        case ASTNodeKind::ExprStmt:
+            visit(node.a);
+            break;
+        default:
+            break;
+        }
+        node.type = type;
+        return type;
+    }
+
+    static ValueType binary(Lexer::TokenKind op, ValueType lhs,
+                            ValueType rhs) {
+        switch (op) {
+        case Lexer::TokenKind::EQ:
+        case Lexer::TokenKind::NEQ:
+        case Lexer::TokenKind::LT:
+        case Lexer::TokenKind::LTE:
+        case Lexer::TokenKind::GT:
+        case Lexer::TokenKind::GTE:
+            return ValueType::Bool;
+        case Lexer::TokenKind::ADD:
+            if (lhs == ValueType::String && rhs == ValueType::String)
+                return ValueType::String;
+            [[fallthrough]];
+        case Lexer::TokenKind::SUB:
+        case Lexer::TokenKind::MUL:
+        case Lexer::TokenKind::DIV:
+        case Lexer::TokenKind::MOD: {
+            auto numeric = [](ValueType t) {
+                return t == ValueType::Int || t == ValueType::Float;
+            };
+            if (!numeric(lhs) || !numeric(rhs))
+                return ValueType::Unknown;
+            // mixed operands are promoted to float
+            return lhs == ValueType::Int && rhs == ValueType::Int
+                       ? ValueType::Int
+                       : ValueType::Float;
+        }
+        default:
+            return ValueType::Unknown;
+        }
+    }
+};
+
+#endif  // __INFER_HH__
@@ -0,0 +1,154 @@
+#ifndef __RESOLVE_HH__
+#define __RESOLVE_HH__
+
+#include <vector>
+
+#include "ast/ast.hh"
+#include "sema/symbol_table.hh"
+
+/// \brief Binds every variable use in an `Ast` to its storage slot.
+/// \details Writes `Node::storage` and the slot operand of each `VarDecl`,
+///          `Assign` and `Identifier`, and the global count of the
+///          `Program`, so code generation needs no name lookups. The main
+///          program is resolved in order, so a global is only visible after
+///          its declaration there; function bodies are resolved afterwards
+///          and see every global. A function's local slots are never
+///          reused, parameters take the first ones; the main program's
+///          top-level blocks all start again at slot zero, which is why code
+///          generation stores zero for a declaration without an initializer.
+///          Names that resolve to nothing stay `Storage::Unresolved` for
+///          code generation to report, only if it reaches them.
+///
+///          This is a walk of its own rather than slots handed out by `Sema`
+///          while parsing: `Sema` only sees names declared so far, so a
+///          function could not bind a global declared below it, and it never
+///          looks up uses. Its table stays for the parse-time diagnostics;
+///          the string maps code generation used to rebuild per frame are
+///          gone.
+class Resolver {
+    Ast &ast;
+    SymbolTable symbols;  // level 0 holds the globals
+    std::vector<NodeId> functions;  // declarations still to resolve
+    u32 globals = 0;
+    u32 locals = 0;  // slots used in the current frame
+
+  public:
+    explicit Resolver(Ast &ast)
+        : ast(ast) {}
+
+    /// Resolve the program and every function body parsed so far.
+    void resolve() {
+        if (ast.root == Ast::NONE)
+            return;
+        for (NodeId stmt : ast.list(ast[ast.root].a))
+            visit(stmt);
+        ast[ast.root].b = globals;
+        drain();
+    }
+
+    /// Resolve a function whose body was parsed after `resolve`, see
+    /// `Parser::parse_body`.
+    void resolve_function(NodeId decl) {
+        functions.push_back(decl);
+        drain();
+    }
+
+  private:
+    void drain() {
+        while (!functions.empty()) {
+            NodeId decl = functions.back();
+            functions.pop_back();
+            function(decl);
+        }
+    }
+
+    void function(NodeId decl) {
+        const Node &func = ast[decl];
+        if (func.c == Ast::NONE || ast[func.c].kind == ASTNodeKind::Deferred)
+            return;
+        locals = 0;
+        symbols.enter_scope();
+        for (NameId param : ast.list(func.b))
+            declare(param);
+        visit(func.c);
+        symbols.exit_scope();
+    }
+
+    // the slot of a new variable, or of the one this scope already has
+    const Symbol &declare(NameId name) {
+        bool global = symbols.current_scope_level() == 0;
+        Symbol sym{name, SymbolKind::Variable, L"auto", std::nullopt,
+                   symbols.current_scope_level()};
+        sym.slot = global ? globals : locals;
+        if (symbols.insert(std::move(sym)))
+            ++(global ? globals : locals);
+        return *symbols.lookup(name);
+    }
+
+    void bind(Node &node) {
+        if (const Symbol *sym = symbols.lookup(node.a)) {
+            node.storage =
+                sym->scope_level == 0 ? Storage::Global : Storage::Local;
+            node.c = sym->slot;
+        }
+    }
+
+    void visit(NodeId id) {
+        if (id == Ast::NONE)
+            return;
+        Node &node = ast[id];
+        switch (node.kind) {
+        case ASTNodeKind::Block:
+            symbols.enter_scope();
+            for (NodeId stmt : ast.list(node.a))
+                visit(stmt);
+            symbols.exit_scope();
+            // a new frame starts at zero once the main program's blocks end
+            if (symbols.current_scope_level() == 0)
+                locals = 0;
+            break;
+        case ASTNodeKind::VarDecl: {
+            // declared before its initializer, as code generation did
+            const Symbol &sym = declare(node.a);
+            node.storage =
+                sym.scope_level == 0 ? Storage::Global : Storage::Local;
+            node.c = sym.slot;
+            visit(node.b);
+            break;
+        }
+        case ASTNodeKind::FuncDecl:
+            functions.push_back(id);
+            break;
+        case ASTNodeKind::Assign:
+            visit(node.b);
+            bind(node);
+            break;
+        case ASTNodeKind::Identifier:
+            bind(node);
+            break;
+        case ASTNodeKind::Call:
+            for (NodeId arg : ast.list(node.b))
+                visit(arg);
+            break;
+        case ASTNodeKind::If:
+            visit(node.a);
+            visit(node.b);
+            visit(node.c);
+            break;
+        case ASTNodeKind::While:
+        case ASTNodeKind::Binary:
+            visit(node.a);
+            visit(node.b);
+            break;
+        case ASTNodeKind::Return:
+        case ASTNodeKind::Unary:
+        case ASTNodeKind::ExprStmt:
+            visit(node.a);
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+#endif  // __RESOLVE_HH__
@@ -9,47 +9,51 @@
 #include "sema/symbol_table.hh"
 
 class Sema {
+    const Interner &names;
     SymbolTable symbols;
     std::vector<std::wstring> errors;
 
   public:
-    Sema() = default;
+    explicit Sema(const Interner &names)
+        : names(names) {}
 
     void enter_scope() { symbols.enter_scope(); }
     void exit_scope() { symbols.exit_scope(); }
 
-    bool declare_variable(const std::wstring &name, const std::wstring &type,
+    bool declare_variable(NameId name, const std::wstring &type,
                           std::optional<std::wstring> value = std::nullopt) {
         Symbol sym{name, SymbolKind::Variable, type, value,
                    symbols.current_scope_level()};
-        if (!symbols.insert(sym)) {
-            errors.push_back(L"Redeclaration of variable: " + name);
+        if (!symbols.insert(std::move(sym))) {
+            errors.push_back(L"Redeclaration of variable: " + names.str(name));
             return false;
         }
         return true;
     }
 
-    bool declare_function(const std::wstring &name, const std::wstring &type,
-                          const std::vector<std::wstring> &params,
+    bool declare_function(NameId name, const std::wstring &type,
+                          const std::vector<NameId> &params,
                           std::optional<std::wstring> ret_type = std::nullopt) {
         Symbol sym{name, type, params, ret_type, symbols.current_scope_level()};
-        if (!symbols.insert(sym)) {
-            errors.push_back(L"Redeclaration of function: " + name);
+        if (!symbols.insert(std::move(sym))) {
+            errors.push_back(L"Redeclaration of function: " + names.str(name));
             return false;
         }
         return true;
     }
 
-    bool declare_import(const std::wstring &name, const std::wstring &module) {
+    bool declare_import(NameId name, NameId module) {
         Symbol sym{name, module, symbols.current_scope_level()};
-        if (!symbols.insert(sym)) {
-            errors.push_back(L"Redeclaration of import: " + name);
+        if (!symbols.insert(std::move(sym))) {
+            errors.push_back(L"Redeclaration of import: " + names.str(name));
             return false;
         }
         return true;
     }
 
-    std::optional<Symbol> lookup(const std::wstring &name) const {
+    /// The innermost symbol named `name`, null if none; valid until its
+    /// scope is left.
+    const Symbol *lookup(NameId name) const {
         return symbols.lookup(name);
     }
 
@@ -57,13 +61,15 @@ class Sema {
 
     bool has_errors() const { return !errors.empty(); }
 
+    const std::vector<std::wstring> &messages() const { return errors; }
+
     void print_errors() const {
         for (const auto &err : errors) {
             std::wcerr << L"Semantic error: " << err << std::endl;
         }
     }
 
-    void debug_print_symbols() const { symbols.debug_print(); }
+    void debug_print_symbols() const { symbols.debug_print(names); }
 };
 
 #endif
\ No newline at end of file
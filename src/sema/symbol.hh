@@ -6,21 +6,25 @@
 #include <variant>
 #include <vector>
 
+#include "types/intern.hh"
+
 enum class SymbolKind { Variable, Function, Parameter, Import };
 
 struct Symbol {
-    std::wstring name;
+    NameId name;
     SymbolKind kind;
     std::wstring type;
     std::optional<std::wstring> value;
     int scope_level;
 
-    std::vector<std::wstring> parameters;
+    std::vector<NameId> parameters;
     std::optional<std::wstring> return_type;
 
-    std::optional<std::wstring> import_module;
+    std::optional<NameId> import_module;
+
+    u32 slot = 0;  // storage index, see `Resolver`
 
-    Symbol(const std::wstring &n, SymbolKind k, const std::wstring &t,
+    Symbol(NameId n, SymbolKind k, const std::wstring &t,
            std::optional<std::wstring> v, int scope)
         : name(n)
         , kind(k)
@@ -28,8 +32,7 @@ struct Symbol {
         , value(v)
         , scope_level(scope) {}
 
-    Symbol(const std::wstring &n, const std::wstring &t,
-           const std::vector<std::wstring> &params,
+    Symbol(NameId n, const std::wstring &t, const std::vector<NameId> &params,
            std::optional<std::wstring> ret, int scope)
         : name(n)
         , kind(SymbolKind::Function)
@@ -39,7 +42,7 @@ struct Symbol {
         , parameters(params)
         , return_type(ret) {}
 
-    Symbol(const std::wstring &n, const std::wstring &mod, int scope)
+    Symbol(NameId n, NameId mod, int scope)
         : name(n)
         , kind(SymbolKind::Import)
         , type(L"import")
@@ -1,54 +1,97 @@
 #ifndef __SYMBOL_TABLE_HH__
 #define __SYMBOL_TABLE_HH__
 
+#include <deque>
 #include <iostream>
-#include <optional>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include "sema/symbol.hh"
+#include "types/rints.hh"
 
+/// \brief Scoped symbols in one flat open-addressing table.
+/// \details The table maps each name to the innermost symbol declared with
+///          it, and every symbol remembers the one it shadows, so a lookup
+///          is one probe sequence however deep the scopes nest. Symbols are
+///          kept in declaration order, which doubles as the undo log:
+///          leaving a scope pops the symbols it declared and puts back what
+///          each one shadowed, in time proportional to those symbols only.
+///          Pointers returned by `lookup` stay valid until the scope
+///          declaring the symbol is left.
 class SymbolTable {
-    std::vector<std::unordered_map<std::wstring, Symbol>> scopes;
+    static constexpr u32 NONE = ~0U;
+
+    struct Slot {
+        NameId name = Interner::NONE;
+        u32 top = NONE;  // innermost symbol with this name
+    };
+
+    struct Link {
+        u32 slot;      // NONE once removed
+        u32 shadowed;  // the symbol it hides, NONE if none
+    };
+
+    std::deque<Symbol> symbols;  // a deque keeps them in place
+    std::vector<Link> links;     // parallel to symbols
+    std::vector<u32> scopes;     // first symbol of each open scope
+    std::vector<Slot> table;
+    u32 used = 0;  // slots holding a name, live or not
 
   public:
-    SymbolTable() { enter_scope(); }
+    SymbolTable()
+        : table(64) {
+        enter_scope();
+    }
 
-    void enter_scope() { scopes.emplace_back(); }
+    void enter_scope() { scopes.push_back(static_cast<u32>(symbols.size())); }
 
     void exit_scope() {
-        if (!scopes.empty())
-            scopes.pop_back();
+        if (scopes.empty())
+            return;
+        for (u32 i = static_cast<u32>(symbols.size()); i-- > scopes.back();)
+            unlink(i);
+        symbols.erase(symbols.begin() + scopes.back(), symbols.end());
+        links.resize(scopes.back());
+        scopes.pop_back();
     }
 
-    bool insert(const Symbol &sym) {
-        auto &current = scopes.back();
-        if (current.count(sym.name))
+    bool insert(Symbol sym) {
+        u32 slot = find(sym.name);
+        u32 top = table[slot].top;
+        if (top != NONE && top >= scopes.back())
             return false;  // redeclaration
-        current[sym.name] = sym;
+        if (table[slot].name == Interner::NONE) {
+            table[slot].name = sym.name;
+            if (++used * 4 > table.size() * 3) {
+                grow();
+                slot = find(sym.name);
+            }
+        }
+        table[slot].top = static_cast<u32>(symbols.size());
+        links.push_back({slot, top});
+        symbols.push_back(std::move(sym));
         return true;
     }
 
-    bool remove(const std::wstring &name) {
-        auto &current = scopes.back();
-        return current.erase(name) > 0;
+    bool remove(NameId name) {
+        u32 top = table[find(name)].top;
+        if (top == NONE || top < scopes.back())
+            return false;
+        unlink(top);
+        return true;
     }
 
-    std::optional<Symbol> lookup(const std::wstring &name) const {
-        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-            auto found = it->find(name);
-            if (found != it->end())
-                return found->second;
-        }
-        return std::nullopt;
+    const Symbol *lookup(NameId name) const {
+        u32 top = table[find(name)].top;
+        return top == NONE ? nullptr : &symbols[top];
     }
 
-    std::vector<Symbol> current_scope_symbols() const {
-        std::vector<Symbol> result;
+    std::vector<const Symbol *> current_scope_symbols() const {
+        std::vector<const Symbol *> result;
         if (!scopes.empty()) {
-            for (const auto &[_, sym] : scopes.back()) {
-                result.push_back(sym);
+            for (u32 i = scopes.back(); i < symbols.size(); ++i) {
+                if (links[i].slot != NONE)
+                    result.push_back(&symbols[i]);
             }
         }
         return result;
@@ -58,16 +101,51 @@ class SymbolTable {
         return static_cast<int>(scopes.size()) - 1;
     }
 
-    void debug_print() const {
-        int level = 0;
-        for (const auto &scope : scopes) {
-            std::wcout << L"Scope " << level++ << L":\n";
-            for (const auto &[name, sym] : scope) {
-                std::wcout << L"  " << name << L" ("
-                           << static_cast<int>(sym.kind) << L")\n";
+    void debug_print(const Interner &names) const {
+        for (usize level = 0; level < scopes.size(); ++level) {
+            std::wcout << L"Scope " << level << L":\n";
+            usize end = level + 1 < scopes.size() ? scopes[level + 1]
+                                                  : symbols.size();
+            for (usize i = scopes[level]; i < end; ++i) {
+                if (links[i].slot == NONE)
+                    continue;
+                std::wcout << L"  " << names.view(symbols[i].name) << L" ("
+                           << static_cast<int>(symbols[i].kind) << L")\n";
             }
         }
     }
+
+  private:
+    // the slot holding `name`, or the empty one where it would go
+    u32 find(NameId name) const {
+        u32 mask = static_cast<u32>(table.size() - 1);
+        u32 slot = static_cast<u32>(name * 0x9E3779B97F4A7C15ULL >> 32) & mask;
+        while (table[slot].name != name && table[slot].name != Interner::NONE)
+            slot = (slot + 1) & mask;
+        return slot;
+    }
+
+    // names are never erased, so growing only has to move the slots
+    void grow() {
+        std::vector<Slot> old(table.size() * 2);
+        old.swap(table);
+        for (const Slot &entry : old) {
+            if (entry.name == Interner::NONE)
+                continue;
+            u32 slot = find(entry.name);
+            table[slot] = entry;
+            for (u32 i = entry.top; i != NONE; i = links[i].shadowed)
+                links[i].slot = slot;
+        }
+    }
+
+    void unlink(u32 symbol) {
+        Link &link = links[symbol];
+        if (link.slot == NONE)
+            return;
+        table[link.slot].top = link.shadowed;
+        link.slot = NONE;
+    }
 };
 
-#endif  // __SYMBOL_TABLE_HH__
\ No newline at end of file
+#endif  // __SYMBOL_TABLE_HH__
@@ -0,0 +1,365 @@
+#ifndef __CORO_H__
+#define __CORO_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "thread/executor.hh"
+#include "types/rints.hh"
+
+template <typename T = void>
+class lazy;
+
+namespace detail {
+// `void` results are stored as an empty value
+template <typename T>
+using lazy_value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+class lazy_promise_base {
+  public:
+    struct final_awaiter {
+        bool await_ready() const noexcept { return false; }
+
+        // hand the thread straight to whoever awaited us
+        template <typename P>
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<P> self) noexcept {
+            return self.promise().continuation;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception() { m_exception = std::current_exception(); }
+
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+
+  protected:
+    void rethrow_if_exception() {
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+  private:
+    std::exception_ptr m_exception;
+};
+
+template <typename T>
+class lazy_promise : public lazy_promise_base {
+  public:
+    lazy<T> get_return_object() noexcept;
+
+    template <typename U = T>
+    void return_value(U &&value) {
+        m_value.emplace(std::forward<U>(value));
+    }
+
+    T result() {
+        rethrow_if_exception();
+        return std::move(*m_value);
+    }
+
+  private:
+    std::optional<T> m_value;
+};
+
+template <>
+class lazy_promise<void> : public lazy_promise_base {
+  public:
+    lazy<void> get_return_object() noexcept;
+
+    void return_void() {}
+
+    void result() { rethrow_if_exception(); }
+};
+
+// an eagerly started coroutine that frees itself when it finishes
+struct detached {
+    struct promise_type {
+        detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+}  // namespace detail
+
+/// \brief A coroutine producing one `T`, started when it is awaited.
+/// \details A `lazy` does nothing until another coroutine `co_await`s it (or
+///          it is handed to `sync_wait`); it then runs on the awaiting thread
+///          until its first suspension, and on completion resumes the awaiter
+///          directly. Where it runs is decided by what it awaits: `schedule`
+///          moves it onto an executor, `offload` runs a blocking call on one.
+///          Exceptions propagate to the awaiter.
+template <typename T>
+class [[nodiscard]] lazy {
+  public:
+    using promise_type = detail::lazy_promise<T>;
+
+    lazy(lazy &&other) noexcept
+        : m_coroutine(std::exchange(other.m_coroutine, nullptr)) {}
+
+    lazy &operator=(lazy &&other) noexcept {
+        if (this != &other) {
+            if (m_coroutine) {
+                m_coroutine.destroy();
+            }
+            m_coroutine = std::exchange(other.m_coroutine, nullptr);
+        }
+        return *this;
+    }
+
+    lazy(const lazy &) = delete;
+    lazy &operator=(const lazy &) = delete;
+
+    ~lazy() {
+        if (m_coroutine) {
+            m_coroutine.destroy();
+        }
+    }
+
+    auto operator co_await() && noexcept {
+        struct awaiter {
+            std::coroutine_handle<promise_type> coroutine;
+
+            bool await_ready() const noexcept { return coroutine.done(); }
+
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                coroutine.promise().continuation = awaiting;
+                return coroutine;
+            }
+
+            T await_resume() { return coroutine.promise().result(); }
+        };
+        return awaiter{m_coroutine};
+    }
+
+  private:
+    friend class detail::lazy_promise<T>;
+
+    explicit lazy(std::coroutine_handle<promise_type> coroutine) noexcept
+        : m_coroutine(coroutine) {}
+
+    std::coroutine_handle<promise_type> m_coroutine;
+};
+
+namespace detail {
+template <typename T>
+lazy<T> lazy_promise<T>::get_return_object() noexcept {
+    return lazy<T>(std::coroutine_handle<lazy_promise<T>>::from_promise(*this));
+}
+
+inline lazy<void> lazy_promise<void>::get_return_object() noexcept {
+    return lazy<void>(
+        std::coroutine_handle<lazy_promise<void>>::from_promise(*this));
+}
+
+template <typename T>
+struct sync_state {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    std::optional<lazy_value<T>> value;
+    std::exception_ptr error;
+};
+
+template <typename T>
+detached run_sync(lazy<T> work, sync_state<T> *state) {
+    try {
+        // a local, so the finished frame is freed before the waiter wakes
+        lazy<T> running = std::move(work);
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(running);
+            state->value.emplace();
+        } else {
+            state->value.emplace(co_await std::move(running));
+        }
+    } catch (...) {
+        state->error = std::current_exception();
+    }
+    // notify under the lock, the waiter owns `state`
+    std::lock_guard lock(state->mutex);
+    state->done = true;
+    state->cv.notify_one();
+}
+
+template <typename T>
+struct join_state {
+    explicit join_state(usize count)
+        : left(count + 1)
+        , values(count) {}
+
+    std::atomic<usize> left;
+    std::coroutine_handle<> parent;
+    std::vector<std::optional<lazy_value<T>>> values;
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    // true for the last arrival
+    bool arrive() { return left.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+};
+
+template <typename T>
+detached join_one(lazy<T> work, join_state<T> *state, usize index) {
+    try {
+        lazy<T> running = std::move(work);
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(running);
+        } else {
+            state->values[index].emplace(co_await std::move(running));
+        }
+    } catch (...) {
+        std::lock_guard lock(state->mutex);
+        if (!state->error) {
+            state->error = std::current_exception();
+        }
+    }
+    if (state->arrive()) {
+        state->parent.resume();
+    }
+}
+}  // namespace detail
+
+/// Continue the awaiting coroutine on one of `exec`'s workers.
+inline auto schedule(Executor exec) noexcept {
+    struct awaiter {
+        Executor exec;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> awaiting) const {
+            exec.submit([awaiting] { awaiting.resume(); });
+        }
+
+        void await_resume() const noexcept {}
+    };
+    return awaiter{exec};
+}
+
+/// Run the blocking call `fn()` on `exec` and continue the awaiting coroutine
+/// there with its result, so the awaiting thread is free meanwhile. Meant
+/// for file reads and data-source lookups; hand them a dedicated
+/// `WorkerThread` to keep them off the compute pool. GCC 12 destroys a
+/// capturing lambda written inside the `co_await` expression twice, so bind
+/// it to a local first.
+template <typename Fn>
+auto offload(Executor exec, Fn &&fn) {
+    using F = std::decay_t<Fn>;
+    using R = std::invoke_result_t<F &>;
+
+    struct awaiter {
+        awaiter(Executor exec, Fn &&fn)
+            : exec(exec)
+            , fn(std::forward<Fn>(fn)) {}
+
+        Executor exec;
+        F fn;
+        std::optional<detail::lazy_value<R>> value;
+        std::exception_ptr error;
+
+        bool await_ready() const noexcept { return false; }
+
+        // the awaiter lives in the suspended frame, so `this` stays valid
+        void await_suspend(std::coroutine_handle<> awaiting) {
+            exec.submit([this, awaiting] {
+                try {
+                    if constexpr (std::is_void_v<R>) {
+                        fn();
+                        value.emplace();
+                    } else {
+                        value.emplace(fn());
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                awaiting.resume();
+            });
+        }
+
+        R await_resume() {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            if constexpr (!std::is_void_v<R>) {
+                return std::move(*value);
+            }
+        }
+    };
+    return awaiter(exec, std::forward<Fn>(fn));
+}
+
+/// Start every coroutine in `works` and continue once all of them finished,
+/// with their results in order. Each runs on the awaiting thread until it
+/// first suspends, so put a `schedule` at the top of those that should run
+/// in parallel. The first exception is rethrown after all of them are done.
+template <typename T>
+lazy<std::conditional_t<std::is_void_v<T>, void, std::vector<T>>>
+when_all(std::vector<lazy<T>> works) {
+    detail::join_state<T> state(works.size());
+
+    struct awaiter {
+        detail::join_state<T> *state;
+        std::vector<lazy<T>> *works;
+
+        bool await_ready() const noexcept { return false; }
+
+        // the extra count keeps the children from resuming us before we
+        // are suspended; if they all finished inline, do not suspend at all
+        bool await_suspend(std::coroutine_handle<> parent) {
+            state->parent = parent;
+            for (usize i = 0; i < works->size(); ++i) {
+                detail::join_one(std::move((*works)[i]), state, i);
+            }
+            return !state->arrive();
+        }
+
+        void await_resume() const noexcept {}
+    };
+    co_await awaiter{&state, &works};
+
+    if (state.error) {
+        std::rethrow_exception(state.error);
+    }
+    if constexpr (!std::is_void_v<T>) {
+        std::vector<T> results;
+        results.reserve(state.values.size());
+        for (auto &value : state.values) {
+            results.push_back(std::move(*value));
+        }
+        co_return results;
+    }
+}
+
+/// Run `work` to completion, blocking the calling thread. Do not call it
+/// from a worker of the executor the work runs on.
+template <typename T>
+T sync_wait(lazy<T> work) {
+    detail::sync_state<T> state;
+    detail::run_sync(std::move(work), &state);
+    {
+        std::unique_lock lock(state.mutex);
+        state.cv.wait(lock, [&] { return state.done; });
+    }
+    if (state.error) {
+        std::rethrow_exception(state.error);
+    }
+    if constexpr (!std::is_void_v<T>) {
+        return std::move(*state.value);
+    }
+}
+
+#endif  // __CORO_H__
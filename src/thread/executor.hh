@@ -0,0 +1,39 @@
+#ifndef __EXECUTOR_H__
+#define __EXECUTOR_H__
+
+#include <memory>
+#include <utility>
+
+#include "thread/task.hh"
+#include "thread/thread.hh"
+
+/// \brief A type-erased reference to a worker thread manager.
+class Executor {
+  public:
+    template <typename M>
+        requires WorkerThreadConcept<M>
+    explicit Executor(M &manager)
+        : manager(&manager)
+        , fn(&submit_to<M>) {}
+
+    void submit(Task task) const { fn(manager, std::move(task)); }
+
+  private:
+    void *manager;
+    void (*fn)(void *, Task &&);
+
+    template <typename M>
+    static void submit_to(void *manager, Task &&task) {
+        auto *m = static_cast<M *>(manager);
+        if constexpr (requires { m->async(std::move(task)); }) {
+            m->async(std::move(task));
+        } else {
+            // the manager only takes copyable callables
+            m->async([shared = std::make_shared<Task>(std::move(task))] {
+                (*shared)();
+            });
+        }
+    }
+};
+
+#endif  // __EXECUTOR_H__
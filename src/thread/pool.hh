@@ -0,0 +1,308 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "thread/task.hh"
+#include "types/rints.hh"
+
+/// \brief A Chase-Lev work-stealing deque.
+/// \details The owning thread pushes and pops at the bottom, any other thread
+///          may steal from the top. The ring grows on demand; retired rings
+///          are kept until the deque is destroyed, since a thief may still
+///          be reading from one.
+///
+/// \tparam T A pointer type, elements are moved around as atomics.
+template <typename T>
+class StealDeque {
+  public:
+    explicit StealDeque(usize capacity = 256)
+        : ring(new Ring(std::bit_ceil(std::max<usize>(capacity, 2)))) {
+        retired.emplace_back(ring.load(std::memory_order_relaxed));
+    }
+
+    StealDeque(const StealDeque &) = delete;
+    StealDeque &operator=(const StealDeque &) = delete;
+
+    /// Owner only.
+    void push(T item) {
+        i64 b = bottom.load(std::memory_order_relaxed);
+        i64 t = top.load(std::memory_order_acquire);
+        Ring *r = ring.load(std::memory_order_relaxed);
+        if (b - t > static_cast<i64>(r->mask)) {
+            r = grow(r, t, b);
+        }
+        r->put(b, item);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    /// Owner only, newest first. Returns `nullptr` when empty.
+    T pop() {
+        i64 b = bottom.load(std::memory_order_relaxed) - 1;
+        Ring *r = ring.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        i64 t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T item = r->get(b);
+        if (t == b) {
+            // last element, race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1,
+                                             std::memory_order_seq_cst,
+                                             std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /// Any thread, oldest first. Returns `nullptr` when empty or when it
+    /// lost a race.
+    T steal() {
+        i64 t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        i64 b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return nullptr;
+        }
+
+        T item = ring.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    bool empty() const {
+        return bottom.load(std::memory_order_relaxed) <=
+               top.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct Ring {
+        usize mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+
+        explicit Ring(usize size)
+            : mask(size - 1)
+            , slots(new std::atomic<T>[size]) {}
+
+        T get(i64 at) const {
+            return slots[static_cast<usize>(at) & mask].load(
+                std::memory_order_relaxed);
+        }
+        void put(i64 at, T item) {
+            slots[static_cast<usize>(at) & mask].store(
+                item, std::memory_order_relaxed);
+        }
+    };
+
+    Ring *grow(Ring *old, i64 t, i64 b) {
+        auto *bigger = new Ring((old->mask + 1) * 2);
+        for (i64 i = t; i < b; ++i) {
+            bigger->put(i, old->get(i));
+        }
+        retired.emplace_back(bigger);
+        ring.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(64) std::atomic<i64> top{0};
+    alignas(64) std::atomic<i64> bottom{0};
+    std::atomic<Ring *> ring;
+    std::vector<std::unique_ptr<Ring>> retired;
+};
+
+/// \brief A fixed set of worker threads sharing work by stealing.
+/// \details Every worker owns a `StealDeque`. Tasks submitted from a worker
+///          go to its own deque, tasks from any other thread go to a shared
+///          injection queue. An idle worker first drains its own deque, then
+///          the injection queue, then steals from the others, and parks on an
+///          atomic once there is nothing left anywhere.
+///
+///          `async` gives no ordering guarantee. Work that must run in call
+///          order, one task at a time, goes through `ordered`; the lane is
+///          drained by whichever worker picks it up. Queued work is finished
+///          before the destructor returns.
+class ThreadPool {
+  public:
+    ThreadPool()
+        : ThreadPool(std::max(1U, std::thread::hardware_concurrency())) {}
+
+    explicit ThreadPool(usize threads) {
+        threads = std::max<usize>(threads, 1);
+        for (usize i = 0; i < threads; ++i) {
+            queues.push_back(std::make_unique<StealDeque<Task *>>());
+        }
+        for (usize i = 0; i < threads; ++i) {
+            workers.emplace_back([this, i] { loop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        running.store(false, std::memory_order_release);
+        wake(true);
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ThreadPool(ThreadPool &&) = delete;
+    ThreadPool &operator=(ThreadPool &&) = delete;
+
+    /// Run `fn` on some worker, in no particular order.
+    template <typename Fn>
+    void async(Fn &&fn) {
+        auto *task = new Task(std::forward<Fn>(fn));
+        if (self == this) {
+            queues[index]->push(task);
+        } else {
+            std::lock_guard lock(inject_mutex);
+            inject.push_back(task);
+        }
+        wake(false);
+    }
+
+    /// Run `fn` after every task previously passed to `ordered` finished.
+    template <typename Fn>
+    void ordered(Fn &&fn) {
+        {
+            std::lock_guard lock(lane.mutex);
+            lane.tasks.emplace(std::forward<Fn>(fn));
+            if (lane.active) {
+                return;
+            }
+            lane.active = true;
+        }
+        async([this] { drain(); });
+    }
+
+    usize size() const { return workers.size(); }
+
+  private:
+    struct Lane {
+        std::mutex mutex;
+        std::queue<Task> tasks;
+        bool active = false;
+    };
+
+    std::vector<std::unique_ptr<StealDeque<Task *>>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex inject_mutex;
+    std::deque<Task *> inject;
+    Lane lane;
+
+    std::atomic<bool> running = true;
+    std::atomic<u32> epoch = 0;
+    std::atomic<u32> sleeping = 0;
+
+    // the pool and worker index of the calling thread, if it is a worker
+    inline static thread_local ThreadPool *self = nullptr;
+    inline static thread_local usize index = 0;
+
+    // epoch and sleeping are seq_cst on both sides: a worker going to sleep
+    // either sees the new epoch or is seen as sleeping
+    void wake(bool all) {
+        epoch.fetch_add(1);
+        if (sleeping.load() == 0) {
+            return;
+        }
+        if (all) {
+            epoch.notify_all();
+        } else {
+            epoch.notify_one();
+        }
+    }
+
+    Task *find(usize id, u64 &seed) {
+        if (Task *task = queues[id]->pop()) {
+            return task;
+        }
+
+        {
+            std::lock_guard lock(inject_mutex);
+            if (!inject.empty()) {
+                Task *task = inject.front();
+                inject.pop_front();
+                return task;
+            }
+        }
+
+        // start at a random victim so thieves spread out
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        usize n = queues.size();
+        for (usize k = 0, at = seed % n; k < n; ++k, at = (at + 1) % n) {
+            if (at == id) {
+                continue;
+            }
+            if (Task *task = queues[at]->steal()) {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void loop(usize id) {
+        self = this;
+        index = id;
+        u64 seed = 0x9E3779B97F4A7C15ULL * (id + 1);
+
+        for (;;) {
+            u32 seen = epoch.load();
+            if (Task *task = find(id, seed)) {
+                std::unique_ptr<Task> owned(task);
+                (*owned)();
+                continue;
+            }
+            if (!running.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            // anything submitted after `seen` was read bumps the epoch, so
+            // the wait below can not miss it
+            sleeping.fetch_add(1);
+            epoch.wait(seen);
+            sleeping.fetch_sub(1);
+        }
+    }
+
+    // run ordered tasks one after another until the lane is empty
+    void drain() {
+        for (;;) {
+            Task task;
+            {
+                std::lock_guard lock(lane.mutex);
+                if (lane.tasks.empty()) {
+                    lane.active = false;
+                    return;
+                }
+                task = std::move(lane.tasks.front());
+                lane.tasks.pop();
+            }
+            task();
+        }
+    }
+};
+
+#endif  // __POOL_H__
@@ -0,0 +1,94 @@
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <utility>
+
+#include "types/rints.hh"
+
+/// Tell the cpu we are spinning.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/// \brief A bounded lock-free queue for many producers and one consumer.
+/// \details Every cell carries a sequence number telling whose turn it is
+///          (Vyukov's bounded queue). Producers claim a cell with one CAS on
+///          the head and publish it by bumping the cell's sequence, the
+///          consumer needs no atomic read-modify-write at all.
+///
+/// \tparam T A default constructible, movable type.
+template <typename T>
+class MpscRing {
+  public:
+    explicit MpscRing(usize capacity)
+        : mask(std::bit_ceil(std::max<usize>(capacity, 2)) - 1)
+        , cells(new Cell[mask + 1]) {
+        for (usize i = 0; i <= mask; ++i) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing &) = delete;
+    MpscRing &operator=(const MpscRing &) = delete;
+
+    /// Any thread. Leaves `value` untouched and returns false when full.
+    bool try_push(T &value) {
+        usize pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = cells[pos & mask];
+            usize seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<isize>(seq - pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// Consumer only. Returns false when empty.
+    bool try_pop(T &out) {
+        Cell &cell = cells[tail & mask];
+        if (cell.seq.load(std::memory_order_acquire) != tail + 1) {
+            return false;
+        }
+        out = std::move(cell.value);
+        cell.seq.store(tail + mask + 1, std::memory_order_release);
+        ++tail;
+        return true;
+    }
+
+    /// Consumer only.
+    bool empty() const {
+        return cells[tail & mask].seq.load(std::memory_order_acquire) !=
+               tail + 1;
+    }
+
+  private:
+    struct Cell {
+        std::atomic<usize> seq;
+        T value;
+    };
+
+    const usize mask;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<usize> head{0};
+    alignas(64) usize tail = 0;
+};
+
+#endif  // __RING_H__
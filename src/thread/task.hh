@@ -0,0 +1,107 @@
+#ifndef __TASK_H__
+#define __TASK_H__
+
+#include <concepts>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "types/rints.hh"
+
+/// \brief A move-only `void()` callable with inline storage.
+/// \details Callables up to `INLINE` bytes that can be moved without throwing
+///          live inside the task itself, so submitting a typical lambda does
+///          not allocate. Anything larger is boxed on the heap. A task is a
+///          single cache line.
+class Task {
+  public:
+    static constexpr usize INLINE = 48;
+
+    Task() = default;
+
+    template <typename Fn>
+        requires(!std::same_as<std::decay_t<Fn>, Task> &&
+                 std::invocable<std::decay_t<Fn> &>)
+    Task(Fn &&fn) {  // NOLINT: implicit on purpose, like std::function
+        using F = std::decay_t<Fn>;
+        if constexpr (fits<F>) {
+            ::new (static_cast<void *>(storage)) F(std::forward<Fn>(fn));
+            ops = &inline_ops<F>;
+        } else {
+            ::new (static_cast<void *>(storage)) F *(new F(std::forward<Fn>(fn)));
+            ops = &boxed_ops<F>;
+        }
+    }
+
+    Task(Task &&other) noexcept { take(other); }
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() { reset(); }
+
+    explicit operator bool() const { return ops != nullptr; }
+
+    void operator()() { ops->call(storage); }
+
+    void reset() {
+        if (ops != nullptr) {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+  private:
+    struct Ops {
+        void (*call)(void *);
+        void (*move)(void *dst, void *src);  // also destroys src
+        void (*destroy)(void *);
+    };
+
+    template <typename F>
+    static constexpr bool fits =
+        sizeof(F) <= INLINE && alignof(F) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible_v<F>;
+
+    template <typename F>
+    static constexpr Ops inline_ops = {
+        [](void *p) { (*static_cast<F *>(p))(); },
+        [](void *dst, void *src) {
+            ::new (dst) F(std::move(*static_cast<F *>(src)));
+            static_cast<F *>(src)->~F();
+        },
+        [](void *p) { static_cast<F *>(p)->~F(); },
+    };
+
+    template <typename F>
+    static constexpr Ops boxed_ops = {
+        [](void *p) { (**static_cast<F **>(p))(); },
+        [](void *dst, void *src) {
+            ::new (dst) F *(*static_cast<F **>(src));
+        },
+        [](void *p) { delete *static_cast<F **>(p); },
+    };
+
+    void take(Task &other) {
+        if (other.ops != nullptr) {
+            other.ops->move(storage, other.storage);
+            ops = std::exchange(other.ops, nullptr);
+        }
+    }
+
+    alignas(std::max_align_t) std::byte storage[INLINE];
+    const Ops *ops = nullptr;
+};
+
+static_assert(sizeof(Task) <= 64, "Task must fit in a cache line");
+
+#endif  // __TASK_H__
@@ -0,0 +1,292 @@
+#ifndef __TASK_GRAPH_H__
+#define __TASK_GRAPH_H__
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "thread/executor.hh"
+#include "thread/task.hh"
+#include "thread/thread.hh"
+#include "types/rints.hh"
+
+template <typename T>
+class Future;
+class TaskGraph;
+
+namespace Graph {
+    // `void` results are stored as an empty value
+    template <typename T>
+    using Stored = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    /// Shared between a future and the task producing it.
+    template <typename T>
+    struct State {
+        explicit State(TaskGraph *graph)
+            : graph(graph) {}
+
+        TaskGraph *graph;
+        std::mutex mutex;
+        std::atomic<bool> done = false;
+        std::optional<Stored<T>> value;
+        std::exception_ptr error;
+        std::vector<Task> waiting;
+
+        template <typename... Args>
+        void set_value(Args &&...args) {
+            value.emplace(std::forward<Args>(args)...);
+            finish();
+        }
+
+        void set_error(std::exception_ptr e) {
+            error = std::move(e);
+            finish();
+        }
+
+        // run `fn` inline once the state is done; callbacks must be cheap
+        // bookkeeping, real work is submitted to the executor
+        void on_done(Task fn) {
+            {
+                std::lock_guard lock(mutex);
+                if (!done.load(std::memory_order_relaxed)) {
+                    waiting.push_back(std::move(fn));
+                    return;
+                }
+            }
+            fn();
+        }
+
+      private:
+        void finish() {
+            std::vector<Task> ready;
+            {
+                std::lock_guard lock(mutex);
+                done.store(true, std::memory_order_release);
+                ready.swap(waiting);
+            }
+            done.notify_all();
+            for (Task &fn : ready) {
+                fn();
+            }
+        }
+    };
+}  // namespace Graph
+
+/// \brief A handle to the result of a task in a `TaskGraph`.
+/// \details Futures are cheap to copy; all copies refer to the same result.
+///          `get` blocks, so call it from outside the workers (or from a task
+///          that depends on this one) to avoid starving a single worker.
+template <typename T>
+class Future {
+  public:
+    Future() = default;
+
+    bool valid() const { return state != nullptr; }
+    bool ready() const {
+        return state->done.load(std::memory_order_acquire);
+    }
+
+    void wait() const { state->done.wait(false, std::memory_order_acquire); }
+
+    /// The result, rethrowing the task's exception if it failed.
+    decltype(auto) get() const {
+        wait();
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return static_cast<const T &>(*state->value);
+        }
+    }
+
+    /// Run `fn` with this future's result (nothing for `void`) once it is
+    /// ready, as another task of the same graph.
+    template <typename Fn>
+    auto then(Fn &&fn) const;
+
+  private:
+    template <typename>
+    friend class Future;
+    friend class TaskGraph;
+
+    explicit Future(std::shared_ptr<Graph::State<T>> state)
+        : state(std::move(state)) {}
+
+    std::shared_ptr<Graph::State<T>> state;
+};
+
+/// \brief Runs tasks with dependencies on a worker thread manager.
+/// \details `spawn` returns a `Future` for the task's result and takes any
+///          number of futures the task must wait for. A task is submitted
+///          to the manager only once all of its dependencies finished, so
+///          no worker ever blocks on another; independent chains (e.g. the
+///          stages of different files) overlap freely. A dependency that
+///          failed fails its dependents with the same exception, without
+///          running them. The graph waits for every task it spawned before
+///          it is destroyed.
+class TaskGraph {
+  public:
+    template <typename M>
+        requires WorkerThreadConcept<M>
+    explicit TaskGraph(M &manager)
+        : exec(manager) {}
+
+    TaskGraph(const TaskGraph &) = delete;
+    TaskGraph &operator=(const TaskGraph &) = delete;
+
+    ~TaskGraph() {
+        wait();
+        // the last task may still be inside retire()
+        std::lock_guard lock(retiring);
+    }
+
+    /// Run `fn()` after every future in `deps` is ready.
+    template <typename Fn, typename... Deps>
+    auto spawn(Fn &&fn, const Future<Deps> &...deps)
+        -> Future<std::invoke_result_t<std::decay_t<Fn> &>> {
+        using R = std::invoke_result_t<std::decay_t<Fn> &>;
+        auto state = std::make_shared<Graph::State<R>>(this);
+        pending.fetch_add(1, std::memory_order_relaxed);
+
+        auto run = [this, state, fn = std::forward<Fn>(fn)]() mutable {
+            try {
+                if constexpr (std::is_void_v<R>) {
+                    fn();
+                    state->set_value();
+                } else {
+                    state->set_value(fn());
+                }
+            } catch (...) {
+                state->set_error(std::current_exception());
+            }
+            retire();
+        };
+
+        if constexpr (sizeof...(Deps) == 0) {
+            exec.submit(std::move(run));
+        } else {
+            auto gate = std::make_shared<Gate>(sizeof...(Deps));
+            auto task = std::make_shared<Task>(std::move(run));
+            (deps.state->on_done([this, gate, task, state, dep = deps.state] {
+                if (dep->error) {
+                    gate->fail(dep->error);
+                }
+                if (gate->arrive()) {
+                    if (gate->error) {
+                        state->set_error(gate->error);
+                        retire();
+                    } else {
+                        exec.submit(std::move(*task));
+                    }
+                }
+            }),
+             ...);
+        }
+        return Future<R>(std::move(state));
+    }
+
+    /// A future that is ready once every future in `deps` is.
+    template <typename... Ts>
+    Future<void> when_all(const Future<Ts> &...deps) {
+        return spawn([] {}, deps...);
+    }
+
+    /// A future that is ready once every future in `deps` is.
+    template <typename T>
+    Future<void> when_all(const std::vector<Future<T>> &deps) {
+        auto state = std::make_shared<Graph::State<void>>(this);
+        if (deps.empty()) {
+            state->set_value();
+            return Future<void>(std::move(state));
+        }
+
+        pending.fetch_add(1, std::memory_order_relaxed);
+        auto gate = std::make_shared<Gate>(deps.size());
+        for (const Future<T> &future : deps) {
+            future.state->on_done([this, gate, state, dep = future.state] {
+                if (dep->error) {
+                    gate->fail(dep->error);
+                }
+                if (gate->arrive()) {
+                    if (gate->error) {
+                        state->set_error(gate->error);
+                    } else {
+                        state->set_value();
+                    }
+                    retire();
+                }
+            });
+        }
+        return Future<void>(std::move(state));
+    }
+
+    /// Block until every task spawned so far has finished.
+    void wait() {
+        for (usize left = pending.load(std::memory_order_acquire); left != 0;
+             left = pending.load(std::memory_order_acquire)) {
+            pending.wait(left, std::memory_order_acquire);
+        }
+    }
+
+    const Executor &executor() const { return exec; }
+
+  private:
+    template <typename>
+    friend class Future;
+
+    // counts down the dependencies of one task, keeping the first failure
+    struct Gate {
+        explicit Gate(usize count)
+            : left(count) {}
+
+        std::atomic<usize> left;
+        std::mutex mutex;
+        std::exception_ptr error;
+
+        void fail(std::exception_ptr e) {
+            std::lock_guard lock(mutex);
+            if (!error) {
+                error = std::move(e);
+            }
+        }
+
+        // true for the last arrival
+        bool arrive() {
+            return left.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+    };
+
+    Executor exec;
+    std::atomic<usize> pending = 0;
+    std::mutex retiring;
+
+    void retire() {
+        std::lock_guard lock(retiring);
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            pending.notify_all();
+        }
+    }
+};
+
+template <typename T>
+template <typename Fn>
+auto Future<T>::then(Fn &&fn) const {
+    return state->graph->spawn(
+        [source = state, fn = std::forward<Fn>(fn)]() mutable -> decltype(auto) {
+            if constexpr (std::is_void_v<T>) {
+                return fn();
+            } else {
+                return fn(static_cast<const T &>(*source->value));
+            }
+        },
+        *this);
+}
+
+#endif  // __TASK_GRAPH_H__
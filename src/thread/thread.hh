@@ -6,7 +6,10 @@
 
 /// \brief A concept that checks if a type is a worker thread manager.
 /// \details The type must be default constructible and must have an `async`
-///          method should maintain call order and not shuffle the calls.
+///          method. `async` makes no promise about the order in which calls
+///          run, or whether they run one at a time; a single `WorkerThread`
+///          happens to keep call order, a `ThreadPool` does not. Callers that
+///          need call order require `OrderedWorkerConcept` instead.
 ///
 /// \tparam T The type to check.
 /// \return `true` if the type is a worker thread manager, `false` otherwise.
@@ -27,4 +30,13 @@ concept WorkerThreadConcept =
         { t.async(fn) } -> std::same_as<void>;
     };
 
+/// \brief A worker thread manager with an ordered lane.
+/// \details Callables passed to `ordered` run one at a time, in call order.
+///          They may interleave with callables passed to `async`.
+template <typename T>
+concept OrderedWorkerConcept =
+    WorkerThreadConcept<T> && requires(T t, std::function<void()> fn) {
+        { t.ordered(fn) } -> std::same_as<void>;
+    };
+
 #endif  // __THEAD_H__
\ No newline at end of file
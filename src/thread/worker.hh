@@ -2,25 +2,29 @@
 #define __WORKER_H__
 
 #include <atomic>
-#include <condition_variable>
-#include <functional>
-#include <mutex>
-#include <queue>
 #include <thread>
+#include <utility>
 
+#include "thread/ring.hh"
+#include "thread/task.hh"
+#include "types/rints.hh"
+
+/// \brief A single background thread running tasks in call order.
+/// \details Tasks go through a bounded lock-free ring, so submitting one
+///          neither allocates (for small captures) nor takes a lock. The
+///          thread spins briefly when the ring runs dry and then parks on an
+///          atomic; producers only pay for a wake-up when it is parked. When
+///          the ring is full producers wait for space, except the worker
+///          itself, which runs the oldest task to make room. Queued tasks
+///          are finished before the destructor returns.
 class WorkerThread {
   public:
-    WorkerThread() {
-        running = true;
-        worker = std::thread([this] { this->loop(); });
-    }
+    WorkerThread() { worker = std::thread([this] { this->loop(); }); }
 
     ~WorkerThread() {
-        {
-            std::lock_guard<std::mutex> lock(mutex);
-            running = false;
-        }
-        cv.notify_all();
+        running.store(false);
+        signal.fetch_add(1);
+        signal.notify_one();
         if (worker.joinable()) {
             worker.join();
         }
@@ -31,36 +35,87 @@ class WorkerThread {
     WorkerThread(WorkerThread &&) = delete;
     WorkerThread &operator=(WorkerThread &&) = delete;
 
-    void async(std::function<void()> fn) {
-        {
-            std::lock_guard<std::mutex> lock(mutex);
-            tasks.push(std::move(fn));
+    template <typename Fn>
+    void async(Fn &&fn) {
+        Task task(std::forward<Fn>(fn));
+        while (!tasks.try_push(task)) {
+            if (self == this) {
+                run_one();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        // pairs with the fence in park(): either the worker sees the task or
+        // we see it parked. only the first producer to see it pays the wake.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed) &&
+            sleeping.exchange(false)) {
+            signal.fetch_add(1);
+            signal.notify_one();
         }
-        cv.notify_one();
+    }
+
+    // a single thread already runs everything in call order
+    template <typename Fn>
+    void ordered(Fn &&fn) {
+        async(std::forward<Fn>(fn));
     }
 
   private:
+    static constexpr usize CAPACITY = 1 << 10;
+    static constexpr usize SPIN = 1 << 8;
+
     std::thread worker;
-    std::mutex mutex;
-    std::condition_variable cv;
-    std::queue<std::function<void()>> tasks;
-    std::atomic<bool> running = false;
+    MpscRing<Task> tasks{CAPACITY};
+    std::atomic<bool> running = true;
+    std::atomic<bool> sleeping = false;
+    std::atomic<u32> signal = 0;
+
+    // the worker whose thread is calling, if any
+    inline static thread_local WorkerThread *self = nullptr;
+
+    bool run_one() {
+        Task task;
+        if (!tasks.try_pop(task)) {
+            return false;
+        }
+        task();
+        return true;
+    }
 
     void loop() {
-        while (running) {
-            std::function<void()> task;
-            {
-                std::unique_lock<std::mutex> lock(mutex);
-                cv.wait(lock, [&] { return !tasks.empty() || !running; });
-                if (!running) {
-                    break;
-                }
-                task = std::move(tasks.front());
-                tasks.pop();
+        self = this;
+        for (;;) {
+            if (run_one()) {
+                continue;
+            }
+            if (!running.load()) {
+                return;
+            }
+            park();
+        }
+    }
+
+    void park() {
+        // spinning only pays off when a producer can run at the same time
+        static const usize spin =
+            std::thread::hardware_concurrency() > 1 ? SPIN : 0;
+        for (usize i = 0; i < spin; ++i) {
+            if (!tasks.empty()) {
+                return;
             }
-            task();
+            cpu_relax();
+        }
+
+        u32 seen = signal.load();
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (tasks.empty() && running.load()) {
+            signal.wait(seen);
         }
+        sleeping.store(false, std::memory_order_relaxed);
     }
 };
 
-#endif  // __WORKER_H__
\ No newline at end of file
+#endif  // __WORKER_H__
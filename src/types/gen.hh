@@ -53,7 +53,10 @@ class generator_promise {
         return static_cast<reference_type>(*m_value);
     }
 
-    // Don't allow any use of 'co_await' inside the generator coroutine.
+    // Don't allow any use of 'co_await' inside the generator coroutine: the
+    // consumer resumes it and expects a value or the end once `resume`
+    // returns, and an await that suspends would leave it with neither. Do
+    // the waiting in a `lazy` (thread/coro.hh) and hand the result over.
     template <typename U>
     std::suspend_never await_transform(U &&value) = delete;
 
@@ -0,0 +1,215 @@
+#ifndef __INTERN_H__
+#define __INTERN_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+#include "types/rints.hh"
+
+/// An interned name, see `Interner`.
+using NameId = u32;
+
+/// \brief A thread-safe string interner shared by a whole compilation.
+/// \details Every distinct name is stored once and identified by a 32-bit
+///          id, so later stages compare and hash integers instead of
+///          strings. The table is split into shards by hash, each behind its
+///          own reader/writer lock; the low bits of an id select the shard
+///          and the rest index into it. Each thread keeps a small direct
+///          mapped cache in front of the shards, so repeated names (the common
+///          case in source text) are resolved without taking a lock. Interned
+///          text never moves, so the views returned by `view` stay valid for
+///          the interner's lifetime.
+class Interner {
+  public:
+    static constexpr NameId NONE = UINT32_MAX;
+
+    Interner()
+        : serial(next_serial.fetch_add(1, std::memory_order_relaxed)) {}
+
+    Interner(const Interner &) = delete;
+    Interner &operator=(const Interner &) = delete;
+    Interner(Interner &&) = delete;
+    Interner &operator=(Interner &&) = delete;
+
+    NameId intern(std::wstring_view text) {
+        u64 hash = hash_of(text);
+
+        CacheEntry &cached = cache[hash & (CACHE - 1)];
+        if (cached.serial == serial && cached.hash == hash &&
+            cached.text == text) {
+            return cached.id;
+        }
+
+        NameId id = lookup_or_insert(text, hash);
+        cached = {serial, hash, view(id), id};
+        return id;
+    }
+
+    std::wstring_view view(NameId id) const {
+        if (id == NONE) {
+            return {};
+        }
+        const Shard &shard = shards[id & (SHARDS - 1)];
+        std::shared_lock lock(shard.mutex);
+        return shard.names[id >> SHARD_BITS];
+    }
+
+    string str(NameId id) const { return string(view(id)); }
+
+    usize size() const {
+        usize total = 0;
+        for (const Shard &shard : shards) {
+            std::shared_lock lock(shard.mutex);
+            total += shard.names.size();
+        }
+        return total;
+    }
+
+    /// Hash two characters per step; names are short, so this beats a
+    /// generic byte-wise string hash.
+    static u64 hash_of(std::wstring_view text) {
+        u64 hash = 0x9E3779B97F4A7C15ULL ^ text.size();
+        usize i = 0;
+        for (; i + 2 <= text.size(); i += 2) {
+            u64 pair = static_cast<u64>(static_cast<u32>(text[i])) |
+                       static_cast<u64>(static_cast<u32>(text[i + 1])) << 32;
+            hash = (hash ^ pair) * 0xBF58476D1CE4E5B9ULL;
+            hash ^= hash >> 31;
+        }
+        if (i < text.size()) {
+            hash = (hash ^ static_cast<u32>(text[i])) * 0x94D049BB133111EBULL;
+            hash ^= hash >> 29;
+        }
+        return hash;
+    }
+
+  private:
+    static constexpr u32 SHARD_BITS = 4;
+    static constexpr u32 SHARDS = 1U << SHARD_BITS;
+    static constexpr usize BLOCK = 1 << 14;
+    static constexpr usize CACHE = 1 << 10;
+
+    // zero initialized; serial 0 is never handed out
+    struct CacheEntry {
+        u64 serial;
+        u64 hash;
+        std::wstring_view text;
+        NameId id;
+    };
+
+    // serials are never reused, so a cache entry can not outlive its interner
+    inline static std::atomic<u64> next_serial{1};
+    inline static thread_local std::array<CacheEntry, CACHE> cache{};
+
+    NameId lookup_or_insert(std::wstring_view text, u64 hash) {
+        u32 idx = static_cast<u32>(hash >> 59) & (SHARDS - 1);
+        Shard &shard = shards[idx];
+
+        {
+            std::shared_lock lock(shard.mutex);
+            if (NameId id = shard.find(text, hash); id != NONE) {
+                return id;
+            }
+        }
+
+        std::unique_lock lock(shard.mutex);
+        if (NameId id = shard.find(text, hash); id != NONE) {
+            return id;
+        }
+
+        NameId id = static_cast<NameId>(shard.names.size()) << SHARD_BITS | idx;
+        shard.names.push_back(shard.store(text));
+        shard.insert({hash, shard.names.back(), id});
+        return id;
+    }
+
+    // one open addressing table per shard; slots keep the full hash and the
+    // interned text so a probe touches one cache line before the compare
+    struct Slot {
+        u64 hash;
+        std::wstring_view text;
+        NameId id;
+    };
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::vector<Slot> slots;
+        usize used_slots = 0;
+        std::deque<std::wstring_view> names;
+        std::vector<std::unique_ptr<wchar[]>> blocks;
+        std::vector<std::unique_ptr<wchar[]>> large;
+        usize used = BLOCK;
+
+        NameId find(std::wstring_view text, u64 hash) const {
+            if (slots.empty()) {
+                return NONE;
+            }
+            usize mask = slots.size() - 1;
+            for (usize at = hash & mask;; at = (at + 1) & mask) {
+                const Slot &slot = slots[at];
+                if (slot.id == NONE) {
+                    return NONE;
+                }
+                if (slot.hash == hash && slot.text == text) {
+                    return slot.id;
+                }
+            }
+        }
+
+        void insert(const Slot &entry) {
+            if ((used_slots + 1) * 2 > slots.size()) {
+                std::vector<Slot> old(std::max<usize>(64, slots.size() * 2),
+                                      Slot{0, {}, NONE});
+                old.swap(slots);
+                used_slots = 0;
+                for (const Slot &slot : old) {
+                    if (slot.id != NONE) {
+                        insert(slot);
+                    }
+                }
+            }
+            usize mask = slots.size() - 1;
+            usize at = entry.hash & mask;
+            while (slots[at].id != NONE) {
+                at = (at + 1) & mask;
+            }
+            slots[at] = entry;
+            ++used_slots;
+        }
+
+        // copy `text` into the shard's bump allocated character blocks
+        std::wstring_view store(std::wstring_view text) {
+            // there may be no block yet, and an empty name needs none
+            if (text.empty()) {
+                return {};
+            }
+            if (text.size() > BLOCK / 4) {
+                large.push_back(std::make_unique<wchar[]>(text.size()));
+                text.copy(large.back().get(), text.size());
+                return {large.back().get(), text.size()};
+            }
+
+            if (used + text.size() > BLOCK) {
+                blocks.push_back(std::make_unique<wchar[]>(BLOCK));
+                used = 0;
+            }
+
+            wchar *dst = blocks.back().get() + used;
+            text.copy(dst, text.size());
+            used += text.size();
+            return {dst, text.size()};
+        }
+    };
+
+    const u64 serial;
+    std::array<Shard, SHARDS> shards;
+};
+
+#endif  // __INTERN_H__
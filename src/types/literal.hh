@@ -0,0 +1,47 @@
+#ifndef __LITERAL_H__
+#define __LITERAL_H__
+
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <variant>
+
+#include "types/rints.hh"
+
+/// A decoded numeric literal.
+using Literal = std::variant<i64, f64>;
+
+/// \brief An append-only pool of numeric literals.
+/// \details Literals that do not fit in a token are stored here and referred
+///          to by index. Lexer threads may add to the pool concurrently;
+///          entries never move, so an index stays valid for the pool's
+///          lifetime.
+class Literals {
+  public:
+    Literals() = default;
+
+    Literals(const Literals &) = delete;
+    Literals &operator=(const Literals &) = delete;
+
+    u32 add(Literal value) {
+        std::unique_lock lock(mutex);
+        values.push_back(value);
+        return static_cast<u32>(values.size() - 1);
+    }
+
+    Literal operator[](u32 index) const {
+        std::shared_lock lock(mutex);
+        return values[index];
+    }
+
+    usize size() const {
+        std::shared_lock lock(mutex);
+        return values.size();
+    }
+
+  private:
+    mutable std::shared_mutex mutex;
+    std::deque<Literal> values;
+};
+
+#endif  // __LITERAL_H__
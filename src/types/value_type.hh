@@ -0,0 +1,10 @@
+#ifndef __VALUE_TYPE_H__
+#define __VALUE_TYPE_H__
+
+#include "types/rints.hh"
+
+/// The static type of an expression, and the tag of a value in the VM.
+/// `Unknown` only exists statically: anything may show up at run time.
+enum class ValueType : u8 { Unknown, Int, Float, Bool, String };
+
+#endif // __VALUE_TYPE_H__
@@ -3,15 +3,20 @@
 
 #include <vector>
 #include <string>
-#include <variant>
 #include <cstdint>
 
 enum class OpCode : uint8_t {
     NOP,
     PUSH_INT,
+    PUSH_INT_CONST,
+    PUSH_FLOAT,
     PUSH_STR,
+    POP,
+    DUP,
     LOAD,
     STORE,
+    LOAD_LOCAL,
+    STORE_LOCAL,
     ADD,
     SUB,
     MUL,
@@ -25,8 +30,34 @@ enum class OpCode : uint8_t {
     LTE,
     GT,
     GTE,
+    // the same operations on operands known to have one type
+    ADD_INT,
+    SUB_INT,
+    MUL_INT,
+    DIV_INT,
+    MOD_INT,
+    NEG_INT,
+    EQ_INT,
+    NEQ_INT,
+    LT_INT,
+    LTE_INT,
+    GT_INT,
+    GTE_INT,
+    ADD_FLOAT,
+    SUB_FLOAT,
+    MUL_FLOAT,
+    DIV_FLOAT,
+    NEG_FLOAT,
+    EQ_FLOAT,
+    NEQ_FLOAT,
+    LT_FLOAT,
+    LTE_FLOAT,
+    GT_FLOAT,
+    GTE_FLOAT,
+    CONCAT,
     JMP,
     JMP_IF_FALSE,
+    JMP_IF_TRUE,
     CALL,
     RET,
     PRINT,
@@ -34,16 +65,30 @@ enum class OpCode : uint8_t {
     // ... add more as needed
 };
 
+// the operand is a signed immediate for PUSH_INT, an index into
+// `Bytecode::ints`, `floats` or `strings` for PUSH_INT_CONST, PUSH_FLOAT
+// and PUSH_STR, a slot for loads and stores and an instruction index for
+// jumps and calls
 struct Instruction {
     OpCode op;
-    std::variant<int64_t, std::wstring, size_t> operand;
+    uint32_t operand;
 
-    Instruction(OpCode o) : op(o), operand(0) {}
-    Instruction(OpCode o, int64_t i) : op(o), operand(i) {}
-    Instruction(OpCode o, const std::wstring& s) : op(o), operand(s) {}
-    Instruction(OpCode o, size_t addr) : op(o), operand(addr) {}
+    Instruction(OpCode o = OpCode::NOP, uint32_t operand = 0)
+        : op(o), operand(operand) {}
 };
 
-using Bytecode = std::vector<Instruction>;
+static_assert(sizeof(Instruction) == 8);
+
+// instructions plus the constants they refer to, each stored once
+struct Bytecode {
+    std::vector<Instruction> code;
+    std::vector<int64_t> ints;  // those that do not fit an operand
+    std::vector<double> floats;
+    std::vector<std::wstring> strings;
+
+    size_t size() const { return code.size(); }
+    Instruction &operator[](size_t i) { return code[i]; }
+    const Instruction &operator[](size_t i) const { return code[i]; }
+};
 
 #endif // __BYTECODE_HH__
@@ -1,184 +1,331 @@
 #include "vm/codegen.hh"
 
+#include <bit>
+#include <cstdint>
+#include <iterator>
 #include <stdexcept>
 
-//
-void CodeGenContext::enter_scope() {
-    locals.emplace_back();
-    next_local = 0;
-}
-void CodeGenContext::exit_scope() {
-    if (!locals.empty())
-        locals.pop_back();
-    next_local = locals.empty() ? 0 : locals.back().size();
-}
-size_t CodeGenContext::declare_var(const std::wstring &name, bool is_global) {
-    if (is_global) {
-        auto [it, inserted] = globals.emplace(name, next_global++);
-        return it->second;
-    } else {
-        auto &scope = locals.back();
-        auto [it, inserted] = scope.emplace(name, next_local++);
-        return it->second;
-    }
+static std::string narrow(std::wstring_view name) {
+    return std::string(name.begin(), name.end());
+}
+
+void CodeGen::emit(OpCode op, size_t operand) {
+    if (operand > UINT32_MAX)
+        throw std::runtime_error("Program too large");
+    code.code.emplace_back(op, static_cast<uint32_t>(operand));
 }
-std::optional<size_t> CodeGenContext::resolve_var(const std::wstring &name) {
-    for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
-        auto found = it->find(name);
-        if (found != it->end())
-            return found->second;
+
+void CodeGen::patch(size_t at, size_t target) {
+    if (target > UINT32_MAX)
+        throw std::runtime_error("Program too large");
+    code[at].operand = static_cast<uint32_t>(target);
+}
+
+void CodeGen::push_int(int64_t i) {
+    if (i >= INT32_MIN && i <= INT32_MAX) {
+        emit(OpCode::PUSH_INT, static_cast<uint32_t>(i));
+        return;
     }
-    auto found = globals.find(name);
-    if (found != globals.end())
-        return found->second;
-    return std::nullopt;
+    auto [it, inserted] = int_index.emplace(i, code.ints.size());
+    if (inserted)
+        code.ints.push_back(i);
+    emit(OpCode::PUSH_INT_CONST, it->second);
 }
 
-void CodeGen::emit(OpCode op) { code.emplace_back(op); }
-void CodeGen::emit(OpCode op, int64_t i) { code.emplace_back(op, i); }
-void CodeGen::emit(OpCode op, const std::wstring &s) {
-    code.emplace_back(op, s);
+void CodeGen::push_float(double f) {
+    auto [it, inserted] =
+        float_index.emplace(std::bit_cast<uint64_t>(f), code.floats.size());
+    if (inserted)
+        code.floats.push_back(f);
+    emit(OpCode::PUSH_FLOAT, it->second);
 }
-void CodeGen::emit(OpCode op, size_t addr) { code.emplace_back(op, addr); }
 
-Bytecode CodeGen::generate(const ASTNodePtr &node) {
-    code.clear();
-    ctx = CodeGenContext();
-    gen(node, true);
+void CodeGen::push_string(std::wstring_view s) {
+    auto [it, inserted] =
+        string_index.emplace(std::wstring(s), code.strings.size());
+    if (inserted)
+        code.strings.emplace_back(s);
+    emit(OpCode::PUSH_STR, it->second);
+}
+
+Bytecode CodeGen::generate(const Ast &tree) {
+    code = Bytecode();
+    int_index.clear();
+    float_index.clear();
+    string_index.clear();
+    ast = &tree;
+    globals = tree.root == Ast::NONE ? 0 : tree[tree.root].b;
+    function_index.clear();
+    functions.clear();
+    pending.clear();
+    calls.clear();
+
+    // functions may be called above their declaration
+    if (tree.root != Ast::NONE) {
+        for (NodeId stmt : tree.list(tree[tree.root].a)) {
+            if (tree[stmt].kind == ASTNodeKind::FuncDecl)
+                declare_function(stmt);
+        }
+    }
+    gen(tree.root, true);
     emit(OpCode::HALT);
-    return code;
+
+    // only functions something calls are generated, each once
+    while (!pending.empty()) {
+        size_t index = pending.back();
+        pending.pop_back();
+        gen_function(index);
+    }
+    for (size_t at : calls)
+        patch(at, functions[code[at].operand].entry);
+    return std::move(code);
+}
+
+void CodeGen::declare_function(NodeId decl) {
+    auto [it, inserted] =
+        function_index.emplace((*ast)[decl].a, functions.size());
+    if (inserted)
+        functions.push_back({decl});
+    else
+        functions[it->second] = {decl};
+}
+
+void CodeGen::gen_function(size_t index) {
+    NodeId decl = functions[index].decl;
+    NodeId body = (*ast)[decl].c;
+    if (body != Ast::NONE && (*ast)[body].kind == ASTNodeKind::Deferred) {
+        if (!expand)
+            throw std::runtime_error("Function body was not parsed: " +
+                                     narrow(names.view((*ast)[decl].a)));
+        body = expand(decl);
+    }
+
+    functions[index].entry = code.size();
+    // the arguments are on the stack, last one on top; parameters take
+    // the first local slots
+    for (size_t i = ast->list((*ast)[decl].b).size(); i-- > 0;)
+        emit(OpCode::STORE_LOCAL, i);
+    gen(body, false);
+    push_int(0);
+    emit(OpCode::RET);
+}
+
+void CodeGen::gen_call(const Node &call) {
+    auto args = ast->list(call.b);
+    auto found = function_index.find(call.a);
+    if (found == function_index.end()) {
+        if (names.view(call.a) != L"print")
+            throw std::runtime_error("Undefined function: " +
+                                     narrow(names.view(call.a)));
+        for (NodeId arg : args) {
+            gen(arg, false);
+            emit(OpCode::PRINT);
+        }
+        return;
+    }
+
+    Function &fn = functions[found->second];
+    if (args.size() != ast->list((*ast)[fn.decl].b).size())
+        throw std::runtime_error("Wrong number of arguments to " +
+                                 narrow(names.view(call.a)));
+    for (NodeId arg : args)
+        gen(arg, false);
+    if (!fn.queued) {
+        fn.queued = true;
+        pending.push_back(found->second);
+    }
+    calls.push_back(code.size());
+    emit(OpCode::CALL, found->second);  // patched to the entry
+}
+
+// a store to the slot `Resolver` gave a `VarDecl` or `Assign`
+void CodeGen::gen_store(const Node &node) {
+    if (node.storage == Storage::Unresolved)
+        throw std::runtime_error("Undefined variable: " +
+                                 narrow(names.view(node.a)));
+    emit(node.storage == Storage::Global ? OpCode::STORE : OpCode::STORE_LOCAL,
+         node.c);
+}
+
+// whether an expression statement leaves a value on the stack
+bool CodeGen::pushes_value(NodeId id) const {
+    if (id == Ast::NONE)
+        return false;
+    const Node &node = (*ast)[id];
+    if (node.kind == ASTNodeKind::Assign)
+        return false;
+    if (node.kind == ASTNodeKind::Call)
+        return function_index.contains(node.a);
+    return true;
+}
+
+static OpCode binary_op(Lexer::TokenKind op) {
+    switch (op) {
+    case Lexer::TokenKind::ADD:
+        return OpCode::ADD;
+    case Lexer::TokenKind::SUB:
+        return OpCode::SUB;
+    case Lexer::TokenKind::MUL:
+        return OpCode::MUL;
+    case Lexer::TokenKind::DIV:
+        return OpCode::DIV;
+    case Lexer::TokenKind::MOD:
+        return OpCode::MOD;
+    case Lexer::TokenKind::EQ:
+        return OpCode::EQ;
+    case Lexer::TokenKind::NEQ:
+        return OpCode::NEQ;
+    case Lexer::TokenKind::LT:
+        return OpCode::LT;
+    case Lexer::TokenKind::LTE:
+        return OpCode::LTE;
+    case Lexer::TokenKind::GT:
+        return OpCode::GT;
+    case Lexer::TokenKind::GTE:
+        return OpCode::GTE;
+    default:
+        throw std::runtime_error("Unknown binary op");
+    }
 }
 
-void CodeGen::gen(const ASTNodePtr &node, bool is_global) {
-    if (!node)
+// typed variants of ADD through GTE, in the same order; what has none
+// stays generic
+static constexpr OpCode INT_OPS[] = {
+    OpCode::ADD_INT, OpCode::SUB_INT, OpCode::MUL_INT, OpCode::DIV_INT,
+    OpCode::MOD_INT, OpCode::NEG_INT, OpCode::NOT,     OpCode::EQ_INT,
+    OpCode::NEQ_INT, OpCode::LT_INT,  OpCode::LTE_INT, OpCode::GT_INT,
+    OpCode::GTE_INT};
+static constexpr OpCode FLOAT_OPS[] = {
+    OpCode::ADD_FLOAT, OpCode::SUB_FLOAT, OpCode::MUL_FLOAT, OpCode::DIV_FLOAT,
+    OpCode::MOD,       OpCode::NEG_FLOAT, OpCode::NOT,       OpCode::EQ_FLOAT,
+    OpCode::NEQ_FLOAT, OpCode::LT_FLOAT,  OpCode::LTE_FLOAT, OpCode::GT_FLOAT,
+    OpCode::GTE_FLOAT};
+static_assert(std::size(INT_OPS) ==
+              static_cast<size_t>(OpCode::GTE) -
+                  static_cast<size_t>(OpCode::ADD) + 1);
+
+// the variant of a generic operation whose operands all have `type`
+static OpCode specialize(OpCode op, ValueType type) {
+    size_t index = static_cast<size_t>(op) - static_cast<size_t>(OpCode::ADD);
+    if (type == ValueType::Int)
+        return INT_OPS[index];
+    if (type == ValueType::Float)
+        return FLOAT_OPS[index];
+    if (type == ValueType::String && op == OpCode::ADD)
+        return OpCode::CONCAT;
+    return op;
+}
+
+ValueType CodeGen::type_of(NodeId id) const {
+    return id == Ast::NONE ? ValueType::Unknown : (*ast)[id].type;
+}
+
+void CodeGen::gen(NodeId id, bool is_global) {
+    if (id == Ast::NONE)
         return;
-    switch (node->kind) {
-    case ASTNodeKind::Program: {
-        auto prog = std::static_pointer_cast<Program>(node);
-        for (auto &stmt : prog->body)
+    const Node &node = (*ast)[id];
+    switch (node.kind) {
+    case ASTNodeKind::Program:
+        for (NodeId stmt : ast->list(node.a))
             gen(stmt, true);
         break;
-    }
-    case ASTNodeKind::Block: {
-        ctx.enter_scope();
-        auto block = std::static_pointer_cast<Block>(node);
-        for (auto &stmt : block->statements)
+    case ASTNodeKind::Block:
+        for (NodeId stmt : ast->list(node.a))
             gen(stmt, false);
-        ctx.exit_scope();
         break;
-    }
-    case ASTNodeKind::VarDecl: {
-        auto var = std::static_pointer_cast<VarDecl>(node);
-        size_t slot = ctx.declare_var(var->name, is_global);
-        if (var->init) {
-            gen(var->init, false);
-            emit(OpCode::STORE, slot);
-        }
+    case ASTNodeKind::VarDecl:
+        // the slot may hold a value from an earlier block or iteration
+        if (node.b != Ast::NONE)
+            gen(node.b, false);
+        else
+            push_int(0);
+        gen_store(node);
         break;
-    }
-    case ASTNodeKind::Assign: {
-        auto asn = std::static_pointer_cast<Assign>(node);
-        gen(asn->value, false);
-        auto slot = ctx.resolve_var(asn->name);
-        if (!slot)
-            throw std::runtime_error(
-                "Undefined variable: " +
-                std::string(asn->name.begin(), asn->name.end()));
-        emit(OpCode::STORE, *slot);
+    case ASTNodeKind::FuncDecl:
+        // top-level ones were declared up front
+        if (!is_global)
+            declare_function(id);
         break;
-    }
-    case ASTNodeKind::Identifier: {
-        auto id = std::static_pointer_cast<Identifier>(node);
-        auto slot = ctx.resolve_var(id->name);
-        if (!slot)
-            throw std::runtime_error(
-                "Undefined variable: " +
-                std::string(id->name.begin(), id->name.end()));
-        emit(OpCode::LOAD, *slot);
+    case ASTNodeKind::Return:
+        if (node.a != Ast::NONE)
+            gen(node.a, false);
+        else
+            push_int(0);
+        emit(OpCode::RET);
+        break;
+    case ASTNodeKind::Call:
+        gen_call(node);
+        break;
+    case ASTNodeKind::Assign:
+        gen(node.b, false);
+        gen_store(node);
+        break;
+    case ASTNodeKind::Identifier:
+        if (node.storage == Storage::Unresolved)
+            throw std::runtime_error("Undefined variable: " +
+                                     narrow(names.view(node.a)));
+        emit(node.storage == Storage::Global ? OpCode::LOAD
+                                             : OpCode::LOAD_LOCAL,
+             node.c);
         break;
-    }
     case ASTNodeKind::Number: {
-        auto num = std::static_pointer_cast<Number>(node);
-        emit(OpCode::PUSH_INT, std::stoll(num->value));
+        Literal value = ast->number(node);
+        if (auto *i = std::get_if<i64>(&value))
+            push_int(*i);
+        else
+            push_float(std::get<f64>(value));
         break;
     }
-    case ASTNodeKind::String: {
-        auto str = std::static_pointer_cast<String>(node);
-        emit(OpCode::PUSH_STR, str->value);
+    case ASTNodeKind::String:
+        push_string(ast->text(node));
         break;
-    }
     case ASTNodeKind::Binary: {
-        auto bin = std::static_pointer_cast<Binary>(node);
-        gen(bin->left, false);
-        gen(bin->right, false);
-        if (bin->op == L"+")
-            emit(OpCode::ADD);
-        else if (bin->op == L"-")
-            emit(OpCode::SUB);
-        else if (bin->op == L"*")
-            emit(OpCode::MUL);
-        else if (bin->op == L"/")
-            emit(OpCode::DIV);
-        else if (bin->op == L"%")
-            emit(OpCode::MOD);
-        else if (bin->op == L"==")
-            emit(OpCode::EQ);
-        else if (bin->op == L"!=")
-            emit(OpCode::NEQ);
-        else if (bin->op == L"<")
-            emit(OpCode::LT);
-        else if (bin->op == L"<=")
-            emit(OpCode::LTE);
-        else if (bin->op == L">")
-            emit(OpCode::GT);
-        else if (bin->op == L">=")
-            emit(OpCode::GTE);
-        else
-            throw std::runtime_error("Unknown binary op");
+        gen(node.a, false);
+        gen(node.b, false);
+        OpCode op = binary_op(node.op);
+        if (type_of(node.a) == type_of(node.b))
+            op = specialize(op, type_of(node.a));
+        emit(op);
         break;
     }
-    case ASTNodeKind::Unary: {
-        auto un = std::static_pointer_cast<Unary>(node);
-        gen(un->operand, false);
-        if (un->op == L"-")
-            emit(OpCode::NEG);
-        else if (un->op == L"!")
+    case ASTNodeKind::Unary:
+        gen(node.a, false);
+        if (node.op == Lexer::TokenKind::SUB)
+            emit(specialize(OpCode::NEG, type_of(node.a)));
+        else if (node.op == Lexer::TokenKind::NOT)
             emit(OpCode::NOT);
         else
             throw std::runtime_error("Unknown unary op");
         break;
-    }
-    case ASTNodeKind::ExprStmt: {
-        auto expr = std::static_pointer_cast<ExprStmt>(node);
-        gen(expr->expr, false);
+    case ASTNodeKind::ExprStmt:
+        gen(node.a, false);
+        if (pushes_value(node.a))
+            emit(OpCode::POP);
         break;
-    }
     case ASTNodeKind::If: {
-        auto ifs = std::static_pointer_cast<IfStmt>(node);
-        gen(ifs->cond, false);
+        gen(node.a, false);
         size_t jmp_false = code.size();
-        // emit(OpCode::JMP_IF_FALSE, 0); // patch later
-        gen(ifs->then_branch, false);
-        if (ifs->else_branch) {
+        emit(OpCode::JMP_IF_FALSE, 0);  // patched below
+        gen(node.b, false);
+        if (node.c != Ast::NONE) {
             size_t jmp_end = code.size();
-            // emit(OpCode::JMP, 0); // patch later
-            code[jmp_false].operand = code.size();
-            gen(*ifs->else_branch, false);
-            code[jmp_end].operand = code.size();
+            emit(OpCode::JMP, 0);  // patched below
+            patch(jmp_false, code.size());
+            gen(node.c, false);
+            patch(jmp_end, code.size());
         } else {
-            code[jmp_false].operand = code.size();
+            patch(jmp_false, code.size());
         }
         break;
     }
     case ASTNodeKind::While: {
-        auto wh = std::static_pointer_cast<WhileStmt>(node);
         size_t loop_start = code.size();
-        gen(wh->cond, false);
+        gen(node.a, false);
         size_t jmp_false = code.size();
-        // emit(OpCode::JMP_IF_FALSE, 0); // patch later
-        gen(wh->body, false);
+        emit(OpCode::JMP_IF_FALSE, 0);  // patched below
+        gen(node.b, false);
         emit(OpCode::JMP, loop_start);
-        code[jmp_false].operand = code.size();
+        patch(jmp_false, code.size());
         break;
     }
     default:
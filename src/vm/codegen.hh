@@ -1,41 +1,67 @@
 #ifndef __CODEGEN_HH__
 #define __CODEGEN_HH__
 
-#include <optional>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include "ast/ast.hh"
+#include "types/intern.hh"
 #include "vm/bytecode.hh"
 
-class CodeGenContext {
-  public:
-    std::unordered_map<std::wstring, size_t> globals;
-    std::vector<std::unordered_map<std::wstring, size_t>> locals;
-    size_t next_global = 0;
-    size_t next_local = 0;
-
-    void enter_scope();
-    void exit_scope();
-    size_t declare_var(const std::wstring &name, bool is_global);
-    std::optional<size_t> resolve_var(const std::wstring &name);
-};
-
 class CodeGen {
     Bytecode code;
+    const Interner &names;
+    const Ast *ast = nullptr;
+
+    // a function is generated after the main code, once something calls it
+    struct Function {
+        NodeId decl;
+        size_t entry = 0;
+        bool queued = false;
+    };
+    std::unordered_map<NameId, size_t> function_index;
+    std::vector<Function> functions;
+    std::vector<size_t> pending;  // functions called but not generated
+    std::vector<size_t> calls;    // CALLs holding a function index
 
-    void emit(OpCode op);
-    void emit(OpCode op, int64_t i);
-    void emit(OpCode op, const std::wstring &s);
-    void emit(OpCode op, size_t addr);
+    // constants already in the pool, by value; floats by bit pattern
+    std::unordered_map<int64_t, uint32_t> int_index;
+    std::unordered_map<uint64_t, uint32_t> float_index;
+    std::unordered_map<std::wstring, uint32_t> string_index;
+
+    void emit(OpCode op, size_t operand = 0);
+    void patch(size_t at, size_t target);
+    void push_int(int64_t i);
+    void push_float(double f);
+    void push_string(std::wstring_view s);
 
   public:
-    CodeGenContext ctx;
-    Bytecode generate(const ASTNodePtr &node);
+    size_t globals = 0;  // global slots the program uses
+
+    /// Called with a `FuncDecl` whose body is `Deferred` when the function
+    /// is first called, must return the parsed, resolved and typed body.
+    /// See `Parser::parse_body`, `Resolver::resolve_function` and
+    /// `TypeInference::infer_function`.
+    std::function<NodeId(NodeId)> expand;
+
+    explicit CodeGen(const Interner &names)
+        : names(names) {}
+
+    /// `tree` must have gone through `Resolver::resolve` and
+    /// `TypeInference::infer`.
+    Bytecode generate(const Ast &tree);
 
   private:
-    void gen(const ASTNodePtr &node, bool is_global = false);
+    void gen(NodeId id, bool is_global = false);
+    void gen_call(const Node &call);
+    void gen_store(const Node &node);
+    void gen_function(size_t index);
+    void declare_function(NodeId decl);
+    bool pushes_value(NodeId id) const;
+    ValueType type_of(NodeId id) const;
 };
 
-#endif  // __CODEGEN_HH__
\ No newline at end of file
+#endif  // __CODEGEN_HH__
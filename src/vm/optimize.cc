@@ -0,0 +1,229 @@
+#include "vm/optimize.hh"
+
+#include <cstdint>
+#include <vector>
+
+namespace {
+bool is_branch(OpCode op) {
+    return op == OpCode::JMP || op == OpCode::JMP_IF_FALSE ||
+           op == OpCode::JMP_IF_TRUE || op == OpCode::CALL;
+}
+
+// pushes one value and does nothing else
+bool is_push(OpCode op) {
+    switch (op) {
+    case OpCode::PUSH_INT:
+    case OpCode::PUSH_INT_CONST:
+    case OpCode::PUSH_FLOAT:
+    case OpCode::PUSH_STR:
+    case OpCode::LOAD:
+    case OpCode::LOAD_LOCAL:
+    case OpCode::DUP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// the store that pairs with a load, NOP for anything else
+OpCode store_of(OpCode load) {
+    if (load == OpCode::LOAD)
+        return OpCode::STORE;
+    if (load == OpCode::LOAD_LOCAL)
+        return OpCode::STORE_LOCAL;
+    return OpCode::NOP;
+}
+
+// the comparison that is false exactly when `op` is true, NOP if there is
+// none: NaN and the generic path's mixed operands only allow equality
+OpCode inverse(OpCode op) {
+    switch (op) {
+    case OpCode::EQ:
+        return OpCode::NEQ;
+    case OpCode::NEQ:
+        return OpCode::EQ;
+    case OpCode::EQ_FLOAT:
+        return OpCode::NEQ_FLOAT;
+    case OpCode::NEQ_FLOAT:
+        return OpCode::EQ_FLOAT;
+    case OpCode::EQ_INT:
+        return OpCode::NEQ_INT;
+    case OpCode::NEQ_INT:
+        return OpCode::EQ_INT;
+    case OpCode::LT_INT:
+        return OpCode::GTE_INT;
+    case OpCode::GTE_INT:
+        return OpCode::LT_INT;
+    case OpCode::LTE_INT:
+        return OpCode::GT_INT;
+    case OpCode::GT_INT:
+        return OpCode::LTE_INT;
+    default:
+        return OpCode::NOP;
+    }
+}
+
+OpCode flip(OpCode branch) {
+    return branch == OpCode::JMP_IF_FALSE ? OpCode::JMP_IF_TRUE
+                                          : OpCode::JMP_IF_FALSE;
+}
+
+bool is_conditional(OpCode op) {
+    return op == OpCode::JMP_IF_FALSE || op == OpCode::JMP_IF_TRUE;
+}
+
+// rewrites only ever turn instructions into NOPs or other instructions in
+// place; `compact` removes the NOPs afterwards, so addresses stay valid
+// while a round runs
+class Peephole {
+    std::vector<Instruction> &code;
+    std::vector<bool> targets;  // jumped or called to
+    bool changed = false;
+
+  public:
+    explicit Peephole(std::vector<Instruction> &code)
+        : code(code) {}
+
+    void run(unsigned level) {
+        do {
+            changed = false;
+            mark_targets();
+            straight();
+            if (level >= 2) {
+                thread();
+                dead();
+            }
+            compact();
+        } while (changed);
+    }
+
+  private:
+    void mark_targets() {
+        targets.assign(code.size() + 1, false);
+        for (const Instruction &instr : code) {
+            if (is_branch(instr.op) && instr.operand <= code.size())
+                targets[instr.operand] = true;
+        }
+    }
+
+    void replace(size_t at, OpCode op, uint32_t operand = 0) {
+        code[at] = Instruction(op, operand);
+        changed = true;
+    }
+
+    // whether the load at `at` is the first half of an `x = x`, which is
+    // better dropped than forwarded
+    bool stores_back(size_t at) const {
+        return at + 1 < code.size() && !targets[at + 1] &&
+               store_of(code[at].op) != OpCode::NOP &&
+               code[at + 1].op == store_of(code[at].op) &&
+               code[at + 1].operand == code[at].operand;
+    }
+
+    // pairs of adjacent instructions, the second of which nothing jumps to
+    void straight() {
+        for (size_t i = 0; i + 1 < code.size(); ++i) {
+            if (targets[i + 1])
+                continue;
+            Instruction &a = code[i];
+            Instruction &b = code[i + 1];
+            if (is_push(a.op) && b.op == OpCode::POP) {
+                replace(i, OpCode::NOP);
+                replace(i + 1, OpCode::NOP);
+            } else if (stores_back(i)) {
+                // x = x
+                replace(i, OpCode::NOP);
+                replace(i + 1, OpCode::NOP);
+            } else if (store_of(b.op) != OpCode::NOP &&
+                       a.op == store_of(b.op) && a.operand == b.operand &&
+                       !stores_back(i + 1)) {
+                // the stored value is still at hand
+                replace(i + 1, a.op, a.operand);
+                replace(i, OpCode::DUP);
+            } else if (b.op == OpCode::NOT && inverse(a.op) != OpCode::NOP) {
+                replace(i, inverse(a.op));
+                replace(i + 1, OpCode::NOP);
+            } else if (a.op == OpCode::NOT && is_conditional(b.op)) {
+                replace(i + 1, flip(b.op), b.operand);
+                replace(i, OpCode::NOP);
+            } else {
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    // where a jump to `at` ends up, following unconditional jumps
+    size_t destination(size_t at) const {
+        for (size_t hops = 0; hops < code.size(); ++hops) {
+            if (at >= code.size() || code[at].op != OpCode::JMP)
+                return at;
+            at = code[at].operand;
+        }
+        return at;  // a cycle, any point of it will do
+    }
+
+    void thread() {
+        for (size_t i = 0; i < code.size(); ++i) {
+            Instruction &instr = code[i];
+            if (instr.op == OpCode::CALL || !is_branch(instr.op))
+                continue;
+            size_t to = destination(instr.operand);
+            if (to != instr.operand)
+                replace(i, instr.op, static_cast<uint32_t>(to));
+            if (instr.op == OpCode::JMP && to < code.size() &&
+                (code[to].op == OpCode::RET || code[to].op == OpCode::HALT)) {
+                replace(i, code[to].op);
+            } else if (to == i + 1) {
+                // the condition still has to be popped
+                replace(i, is_conditional(instr.op) ? OpCode::POP
+                                                    : OpCode::NOP);
+            } else if (is_conditional(instr.op) && i + 2 < code.size() &&
+                       to == i + 2 && code[i + 1].op == OpCode::JMP &&
+                       !targets[i + 1]) {
+                // if (c) {} else ..., or a branch around a jump
+                replace(i, flip(instr.op), code[i + 1].operand);
+                replace(i + 1, OpCode::NOP);
+            }
+        }
+    }
+
+    void dead() {
+        bool live = true;
+        for (size_t i = 0; i < code.size(); ++i) {
+            if (targets[i])
+                live = true;
+            if (!live && code[i].op != OpCode::NOP)
+                replace(i, OpCode::NOP);
+            OpCode op = code[i].op;
+            if (op == OpCode::JMP || op == OpCode::RET || op == OpCode::HALT)
+                live = false;
+        }
+    }
+
+    // drop the NOPs and move every target to the instruction that followed
+    // it, which a NOP or a removed pair never changes the effect of
+    void compact() {
+        std::vector<uint32_t> moved(code.size() + 1);
+        uint32_t kept = 0;
+        for (size_t i = 0; i < code.size(); ++i) {
+            moved[i] = kept;
+            if (code[i].op != OpCode::NOP)
+                code[kept++] = code[i];
+        }
+        moved[code.size()] = kept;
+        if (kept != code.size())
+            changed = true;
+        code.resize(kept);
+        for (Instruction &instr : code) {
+            if (is_branch(instr.op) && instr.operand < moved.size())
+                instr.operand = moved[instr.operand];
+        }
+    }
+};
+}  // namespace
+
+void optimize(Bytecode &code, unsigned level) {
+    if (level > 0)
+        Peephole(code.code).run(level);
+}
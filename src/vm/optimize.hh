@@ -0,0 +1,16 @@
+#ifndef __OPTIMIZE_HH__
+#define __OPTIMIZE_HH__
+
+#include "vm/bytecode.hh"
+
+/// Rewrite `code` in place with a peephole pass, run until nothing changes.
+/// Level 1 folds straight-line sequences: pushes that are popped right
+/// away, a load of the slot just stored, self-assignments, a comparison or
+/// `NOT` in front of a conditional jump. Level 2 also threads jumps to
+/// jumps, drops jumps to the next instruction and code after `JMP`, `RET`
+/// or `HALT` that nothing jumps to. Either level removes `NOP`s, moving
+/// jump and call targets to the instruction that followed. Level 0 leaves
+/// `code` alone.
+void optimize(Bytecode &code, unsigned level);
+
+#endif  // __OPTIMIZE_HH__
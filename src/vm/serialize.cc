@@ -0,0 +1,144 @@
+#include "vm/serialize.hh"
+
+#include <bit>
+#include <cstring>
+#include <string>
+
+static_assert(std::endian::native == std::endian::little,
+              "the .csb format is written in native byte order");
+
+static constexpr char MAGIC[4] = {'C', 'S', 'B', '\0'};
+
+template <typename T>
+static void put(std::ostream &out, T value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool get(std::istream &in, T &value) {
+    return static_cast<bool>(
+        in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+static void put_string(std::ostream &out, const std::wstring &s) {
+    put<uint32_t>(out, static_cast<uint32_t>(s.size()));
+    for (wchar_t c : s)
+        put<uint32_t>(out, static_cast<uint32_t>(c));
+}
+
+static bool get_string(std::istream &in, std::wstring &s) {
+    uint32_t length;
+    if (!get(in, length))
+        return false;
+    // grown unit by unit like `get_all`, a corrupt length must not allocate
+    s.clear();
+    for (uint32_t k = 0; k < length; ++k) {
+        uint32_t unit;
+        if (!get(in, unit))
+            return false;
+        s.push_back(static_cast<wchar_t>(unit));
+    }
+    return true;
+}
+
+// a count, then each entry; nothing is reserved up front, so a corrupt
+// count fails at the end of the stream instead of allocating
+template <typename T, typename Put>
+static void put_all(std::ostream &out, const std::vector<T> &items, Put each) {
+    put<uint64_t>(out, items.size());
+    for (const T &item : items)
+        each(item);
+}
+
+template <typename T, typename Get>
+static bool get_all(std::istream &in, std::vector<T> &items, Get each) {
+    uint64_t count;
+    if (!get(in, count))
+        return false;
+    items.clear();
+    for (uint64_t k = 0; k < count; ++k) {
+        T item;
+        if (!each(item))
+            return false;
+        items.push_back(std::move(item));
+    }
+    return true;
+}
+
+// every operand refers to something that exists, so the VM can index
+// with it unchecked; local slots grow the frame and need no bound
+static bool valid(const Bytecode &code, uint64_t globals) {
+    for (const Instruction &instr : code.code) {
+        size_t bound;
+        switch (instr.op) {
+        case OpCode::PUSH_INT_CONST:
+            bound = code.ints.size();
+            break;
+        case OpCode::PUSH_FLOAT:
+            bound = code.floats.size();
+            break;
+        case OpCode::PUSH_STR:
+            bound = code.strings.size();
+            break;
+        case OpCode::LOAD:
+        case OpCode::STORE:
+            bound = globals;
+            break;
+        case OpCode::JMP:
+        case OpCode::JMP_IF_FALSE:
+        case OpCode::JMP_IF_TRUE:
+        case OpCode::CALL:
+            // the end is a target too, running off it stops the VM
+            bound = code.size() + 1;
+            break;
+        default:
+            if (instr.op > OpCode::HALT)
+                return false;
+            continue;
+        }
+        if (instr.operand >= bound)
+            return false;
+    }
+    return true;
+}
+
+void write_bytecode(std::ostream &out, const Bytecode &code, size_t globals) {
+    out.write(MAGIC, sizeof(MAGIC));
+    put<uint32_t>(out, BYTECODE_VERSION);
+    put<uint64_t>(out, globals);
+    put_all(out, code.ints, [&](int64_t i) { put<int64_t>(out, i); });
+    put_all(out, code.floats, [&](double f) { put<double>(out, f); });
+    put_all(out, code.strings,
+            [&](const std::wstring &s) { put_string(out, s); });
+    put_all(out, code.code, [&](const Instruction &instr) {
+        put<uint8_t>(out, static_cast<uint8_t>(instr.op));
+        put<uint32_t>(out, instr.operand);
+    });
+}
+
+bool read_bytecode(std::istream &in, Bytecode &code, size_t &globals) {
+    char magic[sizeof(MAGIC)];
+    uint32_t version;
+    uint64_t n_globals;
+    if (!in.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || !get(in, version) ||
+        version != BYTECODE_VERSION || !get(in, n_globals))
+        return false;
+
+    bool ok =
+        get_all(in, code.ints, [&](int64_t &i) { return get(in, i); }) &&
+        get_all(in, code.floats, [&](double &f) { return get(in, f); }) &&
+        get_all(in, code.strings,
+                [&](std::wstring &s) { return get_string(in, s); }) &&
+        get_all(in, code.code, [&](Instruction &instr) {
+            uint8_t op;
+            if (!get(in, op) || !get(in, instr.operand))
+                return false;
+            instr.op = static_cast<OpCode>(op);
+            return true;
+        });
+    if (!ok || n_globals > UINT32_MAX || !valid(code, n_globals))
+        return false;
+    globals = n_globals;
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef __SERIALIZE_HH__
+#define __SERIALIZE_HH__
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+#include "vm/bytecode.hh"
+
+// bump whenever the layout below or the opcode numbering changes
+constexpr uint32_t BYTECODE_VERSION = 4;
+
+/// Write `code` and its global count in the `.csb` format: a "CSB" magic,
+/// the version and the global count, the integer, float and string pools,
+/// each a count and its entries, then the instruction count and per
+/// instruction its opcode and operand, all little-endian.
+void write_bytecode(std::ostream &out, const Bytecode &code, size_t globals);
+
+/// Read what `write_bytecode` wrote. False on a bad magic, another version,
+/// a truncated stream or an operand out of range: an unknown opcode, a pool
+/// index, global or jump target past the end. Operand types are not
+/// checked; the VM checks string indices itself.
+bool read_bytecode(std::istream &in, Bytecode &code, size_t &globals);
+
+#endif  // __SERIALIZE_HH__
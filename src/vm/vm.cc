@@ -1,134 +1,293 @@
 #include "vm/vm.hh"
 
+#include <cmath>
 #include <stdexcept>
 
-void VM::load(const Bytecode &bc, size_t num_globals) {
-    code = bc;
+static Value of_int(int64_t i) {
+    Value v;
+    v.i = i;
+    return v;
+}
+
+static Value of_float(double f) {
+    Value v;
+    v.type = ValueType::Float;
+    v.f = f;
+    return v;
+}
+
+static Value of_bool(bool b) {
+    Value v;
+    v.type = ValueType::Bool;
+    v.i = b;
+    return v;
+}
+
+void VM::load(Bytecode bc, size_t num_globals) {
+    code = std::move(bc);
     ip = 0;
     stack.clear();
-    str_stack.clear();
-    globals.resize(num_globals, 0);
+    globals.assign(num_globals, Value{});
+    locals.clear();
+    frames.clear();
+    base = 0;
 }
 
 void VM::run() {
-    while (ip < code.size()) {
-        const auto &instr = code[ip++];
+    const std::vector<Instruction> &program = code.code;
+    while (ip < program.size()) {
+        const Instruction instr = program[ip++];
         switch (instr.op) {
         case OpCode::NOP:
             break;
         case OpCode::PUSH_INT:
-            stack.push_back(std::get<int64_t>(instr.operand));
+            stack.push_back(of_int(static_cast<int32_t>(instr.operand)));
             break;
-        case OpCode::PUSH_STR:
-            str_stack.push_back(std::get<std::wstring>(instr.operand));
+        case OpCode::PUSH_INT_CONST:
+            stack.push_back(of_int(code.ints[instr.operand]));
             break;
-        case OpCode::LOAD: {
-            size_t slot = std::get<size_t>(instr.operand);
-            stack.push_back(globals[slot]);
+        case OpCode::PUSH_FLOAT:
+            stack.push_back(of_float(code.floats[instr.operand]));
+            break;
+        case OpCode::PUSH_STR: {
+            Value v;
+            v.type = ValueType::String;
+            v.s = instr.operand;
+            stack.push_back(v);
             break;
         }
+        case OpCode::POP:
+            pop();
+            break;
+        case OpCode::DUP: {
+            Value v = top();
+            stack.push_back(v);
+            break;
+        }
+        case OpCode::LOAD:
+            stack.push_back(globals[instr.operand]);
+            break;
         case OpCode::STORE: {
-            size_t slot = std::get<size_t>(instr.operand);
-            if (stack.empty())
-                throw std::runtime_error("Stack underflow on STORE");
-            globals[slot] = stack.back();
-            stack.pop_back();
+            Value value = pop();
+            globals[instr.operand] = value;
+            break;
+        }
+        case OpCode::LOAD_LOCAL:
+            stack.push_back(local(instr.operand));
+            break;
+        case OpCode::STORE_LOCAL: {
+            Value value = pop();
+            local(instr.operand) = value;
+            break;
+        }
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MUL:
+        case OpCode::DIV:
+        case OpCode::MOD: {
+            Value b = pop();
+            Value a = pop();
+            stack.push_back(arithmetic(instr.op, a, b));
+            break;
+        }
+        case OpCode::NEG: {
+            Value &a = top();
+            if (a.type == ValueType::Float)
+                a.f = -a.f;
+            else if (a.type == ValueType::String)
+                throw std::runtime_error("Cannot negate a string");
+            else
+                a = of_int(-a.i);
+            break;
+        }
+        case OpCode::NOT: {
+            Value &a = top();
+            a = of_bool(!truthy(a));
             break;
         }
-        case OpCode::ADD: {
-            auto b = pop();
-            auto a = pop();
-            stack.push_back(a + b);
+        case OpCode::EQ:
+        case OpCode::NEQ:
+        case OpCode::LT:
+        case OpCode::LTE:
+        case OpCode::GT:
+        case OpCode::GTE: {
+            Value b = pop();
+            Value a = pop();
+            stack.push_back(of_bool(compare(instr.op, a, b)));
             break;
         }
-        case OpCode::SUB: {
-            auto b = pop();
-            auto a = pop();
-            stack.push_back(a - b);
+        // the typed operations trust code generation and check no tags; a
+        // wrong one only makes a wrong number, strings are bounds-checked
+        case OpCode::ADD_INT: {
+            int64_t b = pop().i;
+            top().i += b;
             break;
         }
-        case OpCode::MUL: {
-            auto b = pop();
-            auto a = pop();
-            stack.push_back(a * b);
+        case OpCode::SUB_INT: {
+            int64_t b = pop().i;
+            top().i -= b;
             break;
         }
-        case OpCode::DIV: {
-            auto b = pop();
-            auto a = pop();
+        case OpCode::MUL_INT: {
+            int64_t b = pop().i;
+            top().i *= b;
+            break;
+        }
+        case OpCode::DIV_INT: {
+            int64_t b = pop().i;
             if (b == 0)
                 throw std::runtime_error("Division by zero");
-            stack.push_back(a / b);
+            top().i /= b;
             break;
         }
-        case OpCode::MOD: {
-            auto b = pop();
-            auto a = pop();
-            stack.push_back(a % b);
+        case OpCode::MOD_INT: {
+            int64_t b = pop().i;
+            if (b == 0)
+                throw std::runtime_error("Division by zero");
+            top().i %= b;
             break;
         }
-        case OpCode::NEG: {
-            auto a = pop();
-            stack.push_back(-a);
+        case OpCode::NEG_INT:
+            top().i = -top().i;
+            break;
+        case OpCode::EQ_INT: {
+            int64_t b = pop().i;
+            Value &a = top();
+            a = of_bool(a.i == b);
             break;
         }
-        case OpCode::EQ: {
-            auto b = pop();
-            auto a = pop();
-            stack.push_back(a == b);
+        case OpCode::NEQ_INT: {
+            int64_t b = pop().i;
+            Value &a = top();
+            a = of_bool(a.i != b);
             break;
         }
-        case OpCode::NEQ: {
-            auto b = pop();
-            auto a = pop();
-            stack.push_back(a != b);
+        case OpCode::LT_INT: {
+            int64_t b = pop().i;
+            Value &a = top();
+            a = of_bool(a.i < b);
             break;
         }
-        case OpCode::LT: {
-            auto b = pop();
-            auto a = pop();
-            stack.push_back(a < b);
+        case OpCode::LTE_INT: {
+            int64_t b = pop().i;
+            Value &a = top();
+            a = of_bool(a.i <= b);
             break;
         }
-        case OpCode::LTE: {
-            auto b = pop();
-            auto a = pop();
-            stack.push_back(a <= b);
+        case OpCode::GT_INT: {
+            int64_t b = pop().i;
+            Value &a = top();
+            a = of_bool(a.i > b);
             break;
         }
-        case OpCode::GT: {
-            auto b = pop();
-            auto a = pop();
-            stack.push_back(a > b);
+        case OpCode::GTE_INT: {
+            int64_t b = pop().i;
+            Value &a = top();
+            a = of_bool(a.i >= b);
             break;
         }
-        case OpCode::GTE: {
-            auto b = pop();
-            auto a = pop();
-            stack.push_back(a >= b);
+        case OpCode::ADD_FLOAT: {
+            double b = pop().f;
+            top().f += b;
+            break;
+        }
+        case OpCode::SUB_FLOAT: {
+            double b = pop().f;
+            top().f -= b;
+            break;
+        }
+        case OpCode::MUL_FLOAT: {
+            double b = pop().f;
+            top().f *= b;
+            break;
+        }
+        case OpCode::DIV_FLOAT: {
+            double b = pop().f;
+            top().f /= b;
+            break;
+        }
+        case OpCode::NEG_FLOAT:
+            top().f = -top().f;
+            break;
+        case OpCode::EQ_FLOAT: {
+            double b = pop().f;
+            Value &a = top();
+            a = of_bool(a.f == b);
+            break;
+        }
+        case OpCode::NEQ_FLOAT: {
+            double b = pop().f;
+            Value &a = top();
+            a = of_bool(a.f != b);
+            break;
+        }
+        case OpCode::LT_FLOAT: {
+            double b = pop().f;
+            Value &a = top();
+            a = of_bool(a.f < b);
+            break;
+        }
+        case OpCode::LTE_FLOAT: {
+            double b = pop().f;
+            Value &a = top();
+            a = of_bool(a.f <= b);
+            break;
+        }
+        case OpCode::GT_FLOAT: {
+            double b = pop().f;
+            Value &a = top();
+            a = of_bool(a.f > b);
+            break;
+        }
+        case OpCode::GTE_FLOAT: {
+            double b = pop().f;
+            Value &a = top();
+            a = of_bool(a.f >= b);
+            break;
+        }
+        case OpCode::CONCAT: {
+            uint32_t b = pop().s;
+            Value &a = top();
+            code.strings.push_back(code.strings.at(a.s) + code.strings.at(b));
+            a.s = static_cast<uint32_t>(code.strings.size() - 1);
             break;
         }
         case OpCode::JMP: {
-            ip = std::get<size_t>(instr.operand);
+            ip = instr.operand;
             break;
         }
         case OpCode::JMP_IF_FALSE: {
-            auto cond = pop();
-            size_t addr = std::get<size_t>(instr.operand);
-            if (!cond)
+            Value cond = pop();
+            size_t addr = instr.operand;
+            if (!truthy(cond))
                 ip = addr;
             break;
         }
-        case OpCode::PRINT: {
-            if (!stack.empty()) {
-                std::wcout << stack.back() << std::endl;
-                stack.pop_back();
-            } else if (!str_stack.empty()) {
-                std::wcout << str_stack.back() << std::endl;
-                str_stack.pop_back();
-            }
+        case OpCode::JMP_IF_TRUE: {
+            Value cond = pop();
+            if (truthy(cond))
+                ip = instr.operand;
+            break;
+        }
+        case OpCode::CALL:
+            frames.push_back({ip, base});
+            base = locals.size();
+            ip = instr.operand;
+            break;
+        case OpCode::RET: {
+            // the return value stays on the stack
+            if (frames.empty())
+                return;
+            locals.resize(base);
+            ip = frames.back().ret;
+            base = frames.back().base;
+            frames.pop_back();
             break;
         }
+        case OpCode::PRINT:
+            if (!stack.empty())
+                print(pop());
+            break;
         case OpCode::HALT:
             return;
         default:
@@ -137,10 +296,131 @@ void VM::run() {
     }
 }
 
-int64_t VM::pop() {
-    if (stack.empty())
-        throw std::runtime_error("Stack underflow");
-    int64_t v = stack.back();
+// the untyped path: integers and booleans mix, a float operand makes the
+// operation a float one, strings only concatenate
+Value VM::arithmetic(OpCode op, const Value &a, const Value &b) {
+    bool a_str = a.type == ValueType::String;
+    bool b_str = b.type == ValueType::String;
+    if (a_str || b_str) {
+        if (op != OpCode::ADD || !a_str || !b_str)
+            throw std::runtime_error("Unsupported operand types");
+        Value v = a;
+        code.strings.push_back(code.strings.at(a.s) + code.strings.at(b.s));
+        v.s = static_cast<uint32_t>(code.strings.size() - 1);
+        return v;
+    }
+    if (a.type == ValueType::Float || b.type == ValueType::Float) {
+        double x = a.type == ValueType::Float ? a.f : a.i;
+        double y = b.type == ValueType::Float ? b.f : b.i;
+        switch (op) {
+        case OpCode::ADD:
+            return of_float(x + y);
+        case OpCode::SUB:
+            return of_float(x - y);
+        case OpCode::MUL:
+            return of_float(x * y);
+        case OpCode::DIV:
+            return of_float(x / y);
+        default:
+            return of_float(std::fmod(x, y));
+        }
+    }
+    switch (op) {
+    case OpCode::ADD:
+        return of_int(a.i + b.i);
+    case OpCode::SUB:
+        return of_int(a.i - b.i);
+    case OpCode::MUL:
+        return of_int(a.i * b.i);
+    default:
+        if (b.i == 0)
+            throw std::runtime_error("Division by zero");
+        return of_int(op == OpCode::DIV ? a.i / b.i : a.i % b.i);
+    }
+}
+
+bool VM::compare(OpCode op, const Value &a, const Value &b) const {
+    int order;
+    bool a_str = a.type == ValueType::String;
+    bool b_str = b.type == ValueType::String;
+    if (a_str != b_str) {
+        if (op == OpCode::EQ || op == OpCode::NEQ)
+            return op == OpCode::NEQ;
+        throw std::runtime_error("Cannot order a string and a number");
+    }
+    if (a_str) {
+        order = code.strings.at(a.s).compare(code.strings.at(b.s));
+    } else if (a.type == ValueType::Float || b.type == ValueType::Float) {
+        double x = a.type == ValueType::Float ? a.f : a.i;
+        double y = b.type == ValueType::Float ? b.f : b.i;
+        // NaN is unordered: only != holds
+        if (x != x || y != y)
+            return op == OpCode::NEQ;
+        order = (x > y) - (x < y);
+    } else {
+        order = (a.i > b.i) - (a.i < b.i);
+    }
+    switch (op) {
+    case OpCode::EQ:
+        return order == 0;
+    case OpCode::NEQ:
+        return order != 0;
+    case OpCode::LT:
+        return order < 0;
+    case OpCode::LTE:
+        return order <= 0;
+    case OpCode::GT:
+        return order > 0;
+    default:
+        return order >= 0;
+    }
+}
+
+bool VM::truthy(const Value &v) const {
+    switch (v.type) {
+    case ValueType::Float:
+        return v.f != 0;
+    case ValueType::String:
+        return !code.strings.at(v.s).empty();
+    default:
+        return v.i != 0;
+    }
+}
+
+void VM::print(const Value &v) const {
+    switch (v.type) {
+    case ValueType::Float:
+        std::wcout << v.f << std::endl;
+        break;
+    case ValueType::String:
+        std::wcout << code.strings.at(v.s) << std::endl;
+        break;
+    default:
+        std::wcout << v.i << std::endl;
+        break;
+    }
+}
+
+[[noreturn, gnu::cold]] static void underflow() {
+    throw std::runtime_error("Stack underflow");
+}
+
+Value VM::pop() {
+    if (stack.empty()) [[unlikely]]
+        underflow();
+    Value v = stack.back();
     stack.pop_back();
     return v;
 }
+
+Value &VM::top() {
+    if (stack.empty()) [[unlikely]]
+        underflow();
+    return stack.back();
+}
+
+Value &VM::local(size_t slot) {
+    if (base + slot >= locals.size())
+        locals.resize(base + slot + 1);
+    return locals[base + slot];
+}
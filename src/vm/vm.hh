@@ -1,27 +1,53 @@
 #ifndef __VM_HH__
 #define __VM_HH__
 
+#include <cstdint>
 #include <iostream>
 #include <string>
-#include <unordered_map>
-#include <variant>
 #include <vector>
 
+#include "types/value_type.hh"
 #include "vm/bytecode.hh"
 
+// a tagged value; booleans are 0 or 1 in `i`, strings index the string
+// constants and then the strings made at run time
+struct Value {
+    ValueType type = ValueType::Int;
+    union {
+        int64_t i = 0;
+        double f;
+        uint32_t s;
+    };
+};
+
 class VM {
-    std::vector<int64_t> stack;
-    std::vector<std::wstring> str_stack;
-    std::vector<int64_t> globals;
+    std::vector<Value> stack;
+    std::vector<Value> globals;
+    std::vector<Value> locals;  // every frame's locals, back to back
     size_t ip = 0;
+    size_t base = 0;  // first local of the current frame
+    // strings are immutable, so values share them by index; those made at
+    // run time are appended to the constants in `code.strings`
     Bytecode code;
 
+    struct Frame {
+        size_t ret;
+        size_t base;
+    };
+    std::vector<Frame> frames;
+
   public:
-    void load(const Bytecode &bc, size_t num_globals = 0);
+    void load(Bytecode bc, size_t num_globals = 0);
     void run();
 
   private:
-    int64_t pop();
+    Value pop();
+    Value &top();
+    Value &local(size_t slot);
+    Value arithmetic(OpCode op, const Value &a, const Value &b);
+    bool compare(OpCode op, const Value &a, const Value &b) const;
+    bool truthy(const Value &v) const;
+    void print(const Value &v) const;
 };
 
-#endif  // __VM_HH__
\ No newline at end of file
+#endif  // __VM_HH__
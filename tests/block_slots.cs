@@ -0,0 +1,9 @@
+# sibling top-level blocks share local slots; a declaration without an
+# initializer must not see what the previous block left there
+# expected output: 1, 1, 1, 1
+{ var q = 2.5; }
+{ var r; var s = r + 1; print(s); }
+{ var q = "str"; }
+{ var r; print(r + 1); }
+var i = 0;
+while i < 2 { var n; print(n + 1); n = 7; i = i + 1; }
@@ -0,0 +1,105 @@
+// .csb files read back as written, and every malformed one is rejected
+// with false rather than a crash or an exception
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include "tests/check.hh"
+#include "vm/serialize.hh"
+
+namespace {
+Bytecode sample() {
+    Bytecode code;
+    code.ints = {INT64_MIN, 1LL << 40};
+    code.floats = {2.5, -0.0};
+    code.strings = {L"", L"héllo"};
+    code.code = {
+        {OpCode::PUSH_INT_CONST, 1}, {OpCode::PUSH_FLOAT, 0},
+        {OpCode::PUSH_STR, 1},       {OpCode::STORE, 2},
+        {OpCode::LOAD, 0},           {OpCode::JMP_IF_FALSE, 8},
+        {OpCode::CALL, 7},           {OpCode::RET},
+        {OpCode::HALT},
+    };
+    return code;
+}
+
+std::string written(const Bytecode &code, size_t globals) {
+    std::ostringstream out;
+    write_bytecode(out, code, globals);
+    return out.str();
+}
+
+bool reads(const std::string &bytes) {
+    std::istringstream in(bytes);
+    Bytecode code;
+    size_t globals;
+    return read_bytecode(in, code, globals);
+}
+
+// where a section starts, past the magic, the version and the globals
+constexpr size_t HEADER = 4 + 4 + 8;
+}  // namespace
+
+int main() {
+    Bytecode code = sample();
+    std::string bytes = written(code, 3);
+
+    {
+        std::istringstream in(bytes);
+        Bytecode back;
+        size_t globals = 0;
+        CHECK(read_bytecode(in, back, globals));
+        CHECK(globals == 3);
+        CHECK(back.ints == code.ints);
+        CHECK(back.floats == code.floats);
+        CHECK(back.strings == code.strings);
+        CHECK(back.size() == code.size());
+        for (size_t i = 0; i < back.size() && i < code.size(); ++i) {
+            CHECK(back[i].op == code[i].op);
+            CHECK(back[i].operand == code[i].operand);
+        }
+    }
+
+    // every truncation
+    for (size_t n = 0; n < bytes.size(); ++n)
+        CHECK(!reads(bytes.substr(0, n)));
+
+    // bad magic and another version
+    std::string bad = bytes;
+    bad[0] = 'X';
+    CHECK(!reads(bad));
+    bad = bytes;
+    bad[4] ^= 1;
+    CHECK(!reads(bad));
+
+    // a string length far past the end of the file
+    std::string huge(bytes.substr(0, HEADER));
+    for (int pool = 0; pool < 2; ++pool)
+        huge.append(8, '\0');  // no ints, no floats
+    huge.append("\1\0\0\0\0\0\0\0", 8);  // one string
+    huge.append("\xf0\xff\xff\xff", 4);
+    CHECK(!reads(huge));
+    // and a count no stream could hold
+    huge = bytes.substr(0, HEADER) + std::string(8, '\xff');
+    CHECK(!reads(huge));
+
+    // operands past what they refer to, and an unknown opcode
+    auto rejects = [](Bytecode code, size_t at, Instruction instr,
+                      size_t globals = 3) {
+        code.code[at] = instr;
+        return !reads(written(code, globals));
+    };
+    CHECK(rejects(code, 0, {OpCode::PUSH_INT_CONST, 2}));
+    CHECK(rejects(code, 1, {OpCode::PUSH_FLOAT, 2}));
+    CHECK(rejects(code, 2, {OpCode::PUSH_STR, 2}));
+    CHECK(rejects(code, 3, {OpCode::STORE, 3}));
+    CHECK(rejects(code, 4, {OpCode::LOAD, 0}, 0));
+    CHECK(rejects(code, 5, {OpCode::JMP_IF_FALSE, 10}));
+    CHECK(rejects(code, 6, {OpCode::CALL, UINT32_MAX}));
+    CHECK(rejects(code, 7, {static_cast<OpCode>(0xff)}));
+    // the end itself is a valid target
+    CHECK(!rejects(code, 5, {OpCode::JMP, 9}));
+
+    return failures() != 0;
+}
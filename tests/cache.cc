@@ -0,0 +1,111 @@
+// a stored entry loads back, and anything wrong with it is a miss: a
+// corrupt or truncated entry, a changed import, other options
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "driver/cache.hh"
+#include "tests/check.hh"
+
+namespace fs = std::filesystem;
+
+namespace {
+Bytecode sample() {
+    Bytecode code;
+    code.strings = {L"cached"};
+    code.code = {{OpCode::PUSH_STR, 0}, {OpCode::PRINT}, {OpCode::HALT}};
+    return code;
+}
+
+bool loads(const BytecodeCache &cache, BytecodeCache::Key key) {
+    Bytecode code;
+    usize globals = 0;
+    return cache.load(key, code, globals) && code.size() == 3 &&
+           code.strings == sample().strings && globals == 1;
+}
+
+std::string read(const fs::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+void write(const fs::path &path, const std::string &bytes) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+}
+
+// the only entry in the cache directory
+fs::path entry_in(const fs::path &dir) {
+    for (const auto &file : fs::recursive_directory_iterator(dir)) {
+        if (file.is_regular_file())
+            return file.path();
+    }
+    return {};
+}
+}  // namespace
+
+int main() {
+    fs::path dir = fs::temp_directory_path() /
+                   ("c-set-test-" + std::to_string(std::random_device()()));
+    fs::remove_all(dir);
+    fs::create_directories(dir / "src");
+    fs::path source = dir / "src" / "main.cs";
+    fs::path import = dir / "src" / "lib.cs";
+    write(import, "var x = 1;\n");
+
+    BytecodeCache cache(dir / "cache", 0);
+    BytecodeCache::Key key = cache.key(source, L"import lib;\n");
+    CHECK(!loads(cache, key));
+    cache.store(key, {import}, sample(), 1);
+    CHECK(loads(cache, key));
+
+    // other text, other options
+    CHECK(cache.key(source, L"import lib; ") != key);
+    CHECK(BytecodeCache(dir / "cache", 1).key(source, L"import lib;\n") !=
+          key);
+
+    fs::path entry = entry_in(dir / "cache");
+    const std::string good = read(entry);
+
+    // an import that changed or went away
+    write(import, "var x = 2;\n");
+    CHECK(!loads(cache, key));
+    fs::remove(import);
+    CHECK(!loads(cache, key));
+    write(import, "var x = 1;\n");
+    CHECK(loads(cache, key));
+
+    // every truncation
+    for (usize n = 0; n < good.size(); ++n) {
+        write(entry, good.substr(0, n));
+        CHECK(!loads(cache, key));
+    }
+
+    // an import path length far past the end of the entry; it follows the
+    // magic, the key and the import count
+    std::string bad = good;
+    bad.replace(4 + 8 + 4, 4, "\xf0\xff\xff\xff");
+    write(entry, bad);
+    CHECK(!loads(cache, key));
+
+    // random damage never throws; when it hits nothing that is checked the
+    // entry may still load, otherwise it misses
+    std::mt19937 random(0x5eed);
+    for (int round = 0; round < 500; ++round) {
+        bad = good;
+        for (int n = 1 + random() % 4; n > 0; --n)
+            bad[random() % bad.size()] = static_cast<char>(random());
+        write(entry, bad);
+        Bytecode code;
+        usize globals;
+        cache.load(key, code, globals);
+    }
+
+    write(entry, good);
+    CHECK(loads(cache, key));
+
+    fs::remove_all(dir);
+    return failures() != 0;
+}
@@ -0,0 +1,21 @@
+#ifndef __CHECK_HH__
+#define __CHECK_HH__
+
+#include <iostream>
+
+/// Failed `CHECK`s so far; a test's `main` returns whether there were any.
+inline int &failures() {
+    static int count = 0;
+    return count;
+}
+
+/// Report `cond` with its location if it does not hold, and carry on.
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << __FILE__ << ':' << __LINE__ << ": " #cond "\n";  \
+            ++failures();                                                  \
+        }                                                                  \
+    } while (false)
+
+#endif  // __CHECK_HH__
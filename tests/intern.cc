@@ -0,0 +1,50 @@
+// names intern to one id each, from any number of threads, and read back
+// unchanged
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tests/check.hh"
+#include "types/intern.hh"
+
+int main() {
+    {
+        // the first name of a shard may be empty
+        Interner names;
+        NameId empty = names.intern(L"");
+        CHECK(names.view(empty).empty());
+        CHECK(names.intern(L"") == empty);
+        CHECK(names.intern(L"x") != empty);
+    }
+
+    Interner names;
+    std::wstring large(1 << 14, L'n');
+    NameId big = names.intern(large);
+    CHECK(names.view(big) == large);
+
+    // every thread interns the same names, starting at another one
+    constexpr usize THREADS = 4, NAMES = 5000;
+    std::vector<std::vector<NameId>> ids(THREADS,
+                                         std::vector<NameId>(NAMES));
+    std::vector<std::thread> threads;
+    for (usize t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t] {
+            for (usize k = 0; k < NAMES; ++k) {
+                usize i = (k + t * NAMES / THREADS) % NAMES;
+                ids[t][i] = names.intern(L"name" + std::to_wstring(i));
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    for (usize i = 0; i < NAMES; ++i) {
+        for (usize t = 1; t < THREADS; ++t)
+            CHECK(ids[t][i] == ids[0][i]);
+        CHECK(names.view(ids[0][i]) == L"name" + std::to_wstring(i));
+    }
+    CHECK(names.size() == NAMES + 1);
+
+    return failures() != 0;
+}
@@ -0,0 +1,166 @@
+// every way of lexing a text has to give the tokens one sequential pass
+// gives: relexing after edits, lexing in parallel chunks and in batches
+
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "lexer/lexer.hh"
+#include "tests/check.hh"
+#include "thread/worker.hh"
+#include "types/intern.hh"
+
+namespace {
+using Lex = Lexer::Lexer<WorkerThread>;
+
+Interner names;
+
+bool same(const Lex &a, const Lexer::Token &x, const Lex &b,
+          const Lexer::Token &y) {
+    if (x.kind != y.kind || x.offset != y.offset || x.length != y.length ||
+        x.flags != y.flags)
+        return false;
+    // pooled literals get a new index every time they are lexed
+    if (x.kind == Lexer::TokenKind::NUMBER)
+        return a.source().literal(x) == b.source().literal(y);
+    return x.id == y.id;
+}
+
+bool same(const Lex &a, const Lexer::TokenList &xs, const Lex &b,
+          const Lexer::TokenList &ys) {
+    if (xs.size() != ys.size())
+        return false;
+    for (usize i = 0; i < xs.size(); ++i) {
+        if (!same(a, xs[i], b, ys[i]))
+            return false;
+    }
+    return true;
+}
+
+Lexer::TokenList full(Lex &lexer, const std::string &text) {
+    lexer.reload(text);
+    return lexer.tokenize_parallel(1);
+}
+
+// relex `tokens` of `lexer` for `edits` that turned its text into `after`
+// and compare with a fresh lex of `after`
+bool relexes(Lex &lexer, Lexer::TokenList &tokens, const std::string &after,
+             std::span<const Lexer::Edit> edits) {
+    lexer.reload(after);
+    tokens = lexer.relex(std::move(tokens), edits);
+    Lex fresh(L"", nullptr, &names);
+    return same(lexer, tokens, fresh, full(fresh, after));
+}
+
+// the same for the single edit that turns `before` into `after`
+bool relexes(Lex &lexer, Lexer::TokenList &tokens, const std::string &before,
+             const std::string &after) {
+    usize prefix = 0;
+    while (prefix < before.size() && prefix < after.size() &&
+           before[prefix] == after[prefix])
+        ++prefix;
+    usize suffix = 0;
+    while (suffix < before.size() - prefix && suffix < after.size() - prefix &&
+           before.rbegin()[suffix] == after.rbegin()[suffix])
+        ++suffix;
+    Lexer::Edit edit{static_cast<u32>(prefix),
+                     static_cast<u32>(before.size() - prefix - suffix),
+                     static_cast<u32>(after.size() - prefix - suffix)};
+    return relexes(lexer, tokens, after, std::span(&edit, 1));
+}
+
+bool relexes(const std::string &before, const std::string &after) {
+    Lex lexer(L"", nullptr, &names);
+    Lexer::TokenList tokens = full(lexer, before);
+    return relexes(lexer, tokens, before, after);
+}
+}  // namespace
+
+int main() {
+    // a number grows over text it only looked at before
+    CHECK(relexes("x = 1.y;", "x = 1.5;"));
+    CHECK(relexes("x = 1,28y;", "x = 1,286;"));
+    CHECK(relexes("x = 1ey;", "x = 1e5;"));
+    CHECK(relexes("x = 1e+y;", "x = 1e+5;"));
+    CHECK(relexes("x = 0xg;", "x = 0x1;"));
+    CHECK(relexes("x = 1,234,56y;", "x = 1,234,567;"));
+    // and shrinks once it may not take a group
+    CHECK(relexes("f(1,2345);", "f(1,234);"));
+    CHECK(relexes("f(1,234);", "f(1,2345);"));
+    CHECK(relexes("x = 1.5;", "x = 1.;"));
+    // edits that open or close a string or a comment
+    CHECK(relexes("a = 1; b = 2;", "a = \"1; b = 2;"));
+    CHECK(relexes("a = \"1; b\" = 2;", "a = \"1; b = 2;"));
+    CHECK(relexes("a = 1;\nb = 2;", "a = 1; # \nb = 2;"));
+    CHECK(relexes("a = 1; # x\nb = 2;", "a = 1; # xb = 2;"));
+    // at both ends
+    CHECK(relexes("", "var a;"));
+    CHECK(relexes("var a;", ""));
+    CHECK(relexes("var a;", "var ab;"));
+
+    {
+        // several edits at once, in any order, in old offsets
+        const std::string before = "var a = 1;\nvar b = 2;\nvar c = 3;\n";
+        const std::string after = "var a = 1.5;\nvar b = 2;\nvar cd = 3;\n";
+        Lex lexer(L"", nullptr, &names);
+        Lexer::TokenList tokens = full(lexer, before);
+        const Lexer::Edit edits[] = {{27, 0, 1}, {9, 0, 2}};
+        CHECK(relexes(lexer, tokens, after, edits));
+    }
+
+    // random edits of a line mixing the lookahead cases, applied one after
+    // another to the same token list
+    const std::string alphabet = "0123456789.,e+-_x ;\"#\n";
+    std::mt19937 random(0x5eed);
+    std::string text =
+        "var x = 1,234 + 0x1F * 2.5e-3;\nprint(\"a,b\" + y_1); # 1.5\n"
+        "f(1, 234, 5.0e+1);\n";
+    Lex lexer(L"", nullptr, &names);
+    Lexer::TokenList tokens = full(lexer, text);
+    for (int round = 0; round < 2000; ++round) {
+        std::string next = text;
+        usize at = random() % (next.size() + 1);
+        next.erase(at, std::min<usize>(random() % 3, next.size() - at));
+        for (usize n = random() % 4; n > 0; --n)
+            next.insert(next.begin() + static_cast<isize>(at),
+                        alphabet[random() % alphabet.size()]);
+        if (!relexes(lexer, tokens, text, next)) {
+            std::cerr << "relex differs from a full lex after editing\n"
+                      << text << "\ninto\n"
+                      << next << '\n';
+            ++failures();
+            tokens = full(lexer, next);
+        }
+        text = std::move(next);
+    }
+
+    {
+        // big enough to be cut into chunks; the strings span lines, so some
+        // cuts fall inside one and have to be stitched
+        std::string big;
+        for (int line = 0; big.size() < (4 << 20); ++line) {
+            big += "var v" + std::to_string(line) + " = " +
+                   std::to_string(line) + ",000.5 + 0x" +
+                   std::to_string(line % 100) + ";\n";
+            if (line % 5 == 0)
+                big += "print(\"a string\nthat spans\nthree lines\");\n";
+            if (line % 89 == 0)
+                big += "# a comment with \"a quote\n";
+        }
+        WorkerThread worker;
+        Lex parallel(L"", &worker, &names);
+        parallel.reload(big);
+        Lexer::TokenList pieces = parallel.tokenize_parallel(8);
+        Lex serial(L"", nullptr, &names);
+        CHECK(same(parallel, pieces, serial, full(serial, big)));
+
+        Lexer::TokenList batched;
+        for (std::span<const Lexer::Token> batch :
+             serial.tokenize_batched(1000, 3))
+            batched.insert(batched.end(), batch.begin(), batch.end());
+        CHECK(same(serial, batched, serial, full(serial, big)));
+    }
+
+    return failures() != 0;
+}
@@ -0,0 +1,136 @@
+// the peephole passes do what they say on small sequences, and programs
+// print the same at every level while getting no longer
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ast/parser.hh"
+#include "ast/token_stream.hh"
+#include "lexer/lexer.hh"
+#include "sema/infer.hh"
+#include "sema/resolve.hh"
+#include "tests/check.hh"
+#include "thread/worker.hh"
+#include "types/intern.hh"
+#include "vm/codegen.hh"
+#include "vm/optimize.hh"
+#include "vm/vm.hh"
+
+namespace {
+using Code = std::vector<Instruction>;
+
+Code optimized(Code code, unsigned level = 2) {
+    Bytecode bytecode;
+    bytecode.code = std::move(code);
+    optimize(bytecode, level);
+    return bytecode.code;
+}
+
+bool same(const Code &a, const Code &b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].op != b[i].op || a[i].operand != b[i].operand)
+            return false;
+    }
+    return true;
+}
+
+struct Program {
+    Bytecode code;
+    size_t globals = 0;
+};
+
+Program compile(const std::string &text) {
+    Interner names;
+    Lexer::Lexer<WorkerThread> lexer(L"", nullptr, &names);
+    lexer.reload(text);
+    ParserContext ctx(names);
+    Parser parser(TokenStream(lexer.tokenize_batched()), lexer.source(), ctx);
+    parser.parse_program();
+    Resolver(ctx.ast).resolve();
+    TypeInference(ctx.ast).infer();
+    CodeGen codegen(names);
+    Program program;
+    program.code = codegen.generate(ctx.ast);
+    program.globals = codegen.globals;
+    return program;
+}
+
+std::wstring run(const Program &program) {
+    std::wostringstream out;
+    std::wstreambuf *saved = std::wcout.rdbuf(out.rdbuf());
+    VM vm;
+    vm.load(program.code, program.globals);
+    vm.run();
+    std::wcout.rdbuf(saved);
+    return out.str();
+}
+}  // namespace
+
+int main() {
+    using enum OpCode;
+
+    // a push that is popped right away
+    CHECK(same(optimized({{PUSH_INT, 1}, {POP}, {HALT}}), {{HALT}}));
+    // a load of the slot just stored
+    CHECK(same(optimized({{STORE, 0}, {LOAD, 0}, {PRINT}, {HALT}}),
+               {{DUP}, {STORE, 0}, {PRINT}, {HALT}}));
+    // x = x
+    CHECK(same(optimized({{LOAD_LOCAL, 2}, {STORE_LOCAL, 2}, {HALT}}),
+               {{HALT}}));
+    // a negated comparison, and NOT before a branch
+    CHECK(same(
+        optimized({{LT_INT}, {NOT}, {JMP_IF_FALSE, 4}, {PRINT}, {HALT}}),
+        {{GTE_INT}, {JMP_IF_FALSE, 3}, {PRINT}, {HALT}}));
+    CHECK(same(optimized({{NOT}, {JMP_IF_FALSE, 3}, {PRINT}, {HALT}}),
+               {{JMP_IF_TRUE, 2}, {PRINT}, {HALT}}));
+    // NaN keeps a float < from being inverted
+    CHECK(same(optimized({{LT_FLOAT}, {NOT}, {HALT}}),
+               {{LT_FLOAT}, {NOT}, {HALT}}));
+    // level 1 leaves jumps alone
+    Code jumps = {{JMP, 1}, {JMP, 3}, {PRINT}, {HALT}};
+    CHECK(same(optimized(jumps, 1), jumps));
+    // level 2 threads them, and drops what nothing reaches
+    CHECK(same(optimized(jumps), {{HALT}}));
+    CHECK(same(optimized({{JMP_IF_FALSE, 2}, {JMP, 3}, {PRINT}, {HALT}}),
+               {{JMP_IF_TRUE, 2}, {PRINT}, {HALT}}));
+    // a jump to the next instruction still pops its condition
+    CHECK(same(optimized({{PUSH_INT, 1}, {JMP_IF_FALSE, 2}, {HALT}}),
+               {{HALT}}));
+    // a target keeps the instruction at it
+    CHECK(same(optimized({{PUSH_INT, 1}, {JMP_IF_TRUE, 3}, {POP}, {HALT}}),
+               {{PUSH_INT, 1}, {JMP_IF_TRUE, 3}, {POP}, {HALT}}));
+    // level 0 changes nothing
+    Code pushes = {{PUSH_INT, 1}, {POP}, {NOP}, {HALT}};
+    CHECK(same(optimized(pushes, 0), pushes));
+
+    const char *programs[] = {
+        "var i = 0;\n"
+        "while i < 5 { if !(i == 3) { print(i); } i = i + 1; }\n",
+        "function fib(n) { if n < 2 { return n; } "
+        "return fib(n - 1) + fib(n - 2); }\n"
+        "print(fib(15));\n",
+        "var x = 2.5; var y = x * 4; y = y; print(y / 3);\n"
+        "var s = \"a\"; print(s + \"b\");\n",
+        "function f(a) { var b = a; b = b + 1; if b > 2 { return b; } "
+        "else { return 0; } }\n"
+        "print(f(1)); print(f(5));\n",
+        "{ var a = 1; print(a); } { var b; print(b + 7); }\n",
+    };
+    for (const char *text : programs) {
+        Program plain = compile(text);
+        CHECK(!plain.code.code.empty());
+        std::wstring expected = run(plain);
+        CHECK(!expected.empty());
+        for (unsigned level = 1; level <= 2; ++level) {
+            Program program = plain;
+            optimize(program.code, level);
+            CHECK(program.code.size() <= plain.code.size());
+            CHECK(run(program) == expected);
+        }
+    }
+
+    return failures() != 0;
+}
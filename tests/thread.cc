@@ -0,0 +1,142 @@
+// the worker managers run everything they are given, in order where they
+// promise it; task graphs and coroutines on top of them see every result
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "tests/check.hh"
+#include "thread/coro.hh"
+#include "thread/executor.hh"
+#include "thread/pool.hh"
+#include "thread/task_graph.hh"
+#include "thread/worker.hh"
+
+namespace {
+constexpr usize TASKS = 20000;
+
+// every task runs once, and `ordered` ones one at a time in call order
+template <typename M>
+void runs_everything() {
+    std::atomic<usize> count = 0;
+    std::vector<usize> order;
+    {
+        M manager;
+        for (usize i = 0; i < TASKS; ++i) {
+            manager.async([&] { count.fetch_add(1); });
+            manager.ordered([&, i] { order.push_back(i); });
+        }
+    }
+    CHECK(count == TASKS);
+    CHECK(order.size() == TASKS);
+    for (usize i = 0; i < order.size(); ++i)
+        CHECK(order[i] == i);
+}
+
+lazy<int> square(Executor exec, int n) {
+    co_await schedule(exec);
+    co_return n * n;
+}
+
+lazy<int> sum_of_squares(Executor exec, Executor io, int n) {
+    std::vector<lazy<int>> works;
+    for (int i = 1; i <= n; ++i)
+        works.push_back(square(exec, i));
+    std::vector<int> squares = co_await when_all(std::move(works));
+    // the blocking part on the other executor, bound to a local first
+    auto add = [&squares] {
+        int total = 0;
+        for (int s : squares)
+            total += s;
+        return total;
+    };
+    co_return co_await offload(io, add);
+}
+
+lazy<int> fails(Executor exec) {
+    co_await schedule(exec);
+    throw std::runtime_error("failed");
+}
+}  // namespace
+
+int main() {
+    runs_everything<ThreadPool>();
+    runs_everything<WorkerThread>();
+
+    {
+        // work submitted from inside the pool, stolen by the others
+        std::atomic<usize> count = 0;
+        {
+            ThreadPool pool(4);
+            for (usize i = 0; i < 64; ++i) {
+                pool.async([&] {
+                    for (usize k = 0; k < 256; ++k)
+                        pool.async([&] { count.fetch_add(1); });
+                });
+            }
+        }
+        CHECK(count == 64 * 256);
+    }
+
+    {
+        ThreadPool pool(4);
+        TaskGraph graph(pool);
+
+        // a diamond: both sides see the root, the join sees both sides
+        Future<int> root = graph.spawn([] { return 2; });
+        Future<int> left = root.then([](int x) { return x + 1; });
+        Future<int> right = root.then([](int x) { return x * 10; });
+        Future<int> join = graph.spawn(
+            [left, right] { return left.get() + right.get(); }, left, right);
+        CHECK(join.get() == 23);
+
+        // a long chain of dependent tasks
+        Future<usize> chain = graph.spawn([] { return usize{0}; });
+        for (usize i = 0; i < 1000; ++i)
+            chain = chain.then([](usize x) { return x + 1; });
+        CHECK(chain.get() == 1000);
+
+        // a failure reaches every dependent without running it
+        std::atomic<bool> ran = false;
+        Future<int> bad = graph.spawn([]() -> int {
+            throw std::runtime_error("failed");
+        });
+        Future<int> after = bad.then([&](int x) {
+            ran = true;
+            return x;
+        });
+        bool threw = false;
+        try {
+            after.get();
+        } catch (const std::runtime_error &) {
+            threw = true;
+        }
+        CHECK(threw);
+        CHECK(!ran);
+
+        std::vector<Future<int>> many;
+        for (int i = 0; i < 100; ++i)
+            many.push_back(graph.spawn([i] { return i; }));
+        graph.when_all(many).get();
+        for (int i = 0; i < 100; ++i)
+            CHECK(many[i].get() == i);
+    }
+
+    {
+        ThreadPool pool(4);
+        WorkerThread io;
+        CHECK(sync_wait(sum_of_squares(Executor(pool), Executor(io), 20)) ==
+              2870);
+
+        bool threw = false;
+        try {
+            sync_wait(fails(Executor(pool)));
+        } catch (const std::runtime_error &) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+
+    return failures() != 0;
+}
@@ -12,6 +12,38 @@ target("c-set")
     -- enable multi-thread compilation
     
 
+-- lexer throughput benchmark, build with `xmake build bench_lexer`
+target("bench_lexer")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/lexer.cc")
+    add_headerfiles("bench/**.hh")
+    add_includedirs(".", "src")
+    set_languages("c++23")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+
+-- unit tests, build and run them with `xmake test`; each is listed with
+-- the sources it links besides its own file
+for name, files in pairs({
+    lexer = {},
+    intern = {},
+    bytecode = {"src/vm/serialize.cc"},
+    cache = {"src/driver/cache.cc", "src/vm/serialize.cc"},
+    optimize = {"src/vm/codegen.cc", "src/vm/optimize.cc", "src/vm/vm.cc"},
+    thread = {},
+}) do
+    target("test_" .. name)
+        set_kind("binary")
+        set_default(false)
+        add_files("tests/" .. name .. ".cc", files)
+        add_headerfiles("tests/**.hh")
+        add_includedirs(".", "src")
+        set_languages("c++23")
+        add_syslinks("pthread")
+        add_tests("default")
+end
+
 --
 -- If you want to known more usage about xmake, please see https://xmake.io
 --